@@ -0,0 +1,83 @@
+#include "allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+using namespace std;
+
+
+#ifdef COUNT_HEAP_ALLOCATIONS
+
+static thread_local size_t thread_heap_allocations = 0;
+
+void* operator new(size_t size)
+{
+	thread_heap_allocations++;
+
+	void* const p = malloc(size > 0 ? size : 1);
+
+	if (0 == p)
+		throw bad_alloc();
+
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+	thread_heap_allocations++;
+
+	return malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept
+{
+	return operator new(size, nothrow);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
+
+bool is_counting_heap_allocations(void)
+{
+	return true;
+}
+
+size_t get_thread_heap_allocations(void)
+{
+	return thread_heap_allocations;
+}
+
+#else
+
+bool is_counting_heap_allocations(void)
+{
+	return false;
+}
+
+size_t get_thread_heap_allocations(void)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstddef>
+
+
+// Built with COUNT_HEAP_ALLOCATIONS defined, the global operator new counts the allocations made
+// by each thread, so that a loop can be checked for allocating. Otherwise nothing is counted.
+// Only allocations through operator new are seen, not those that C libraries, like the GL driver, make.
+//
+// To check that rendering allocates nothing once the first xy plane of each w slice is done, build
+// with the macro defined for every translation unit, e.g. g++ -std=c++14 -O2 -DCOUNT_HEAP_ALLOCATIONS
+// *.cpp ..., and render. The count is printed at the end of every render that evaluates, and if it
+// is not zero the render fails, so julia exits with status 1.
+bool is_counting_heap_allocations(void);
+
+// How many heap allocations the calling thread has made so far. Always 0 unless counting.
+size_t get_thread_heap_allocations(void);
+
+
+#endif
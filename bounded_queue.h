@@ -0,0 +1,106 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+#include <vector>
+using std::condition_variable;
+using std::mutex;
+using std::unique_lock;
+using std::vector;
+
+
+// A first-in first-out queue shared by producer and consumer threads.
+// push() blocks while the queue is full, which bounds the memory held in the queue,
+// and returns false once the queue is closed.
+// pop() blocks while the queue is empty, and returns false once the queue is closed and drained.
+// The items live in a ring of max_size slots, made up front, so pushing and popping never allocate.
+template<typename T>
+class bounded_queue
+{
+public:
+
+	bounded_queue(size_t src_max_size) : slots(src_max_size > 0 ? src_max_size : 1), first(0), count(0), closed(false) { }
+
+	// The item is swapped into the queue, so large buffers are not copied. The item is left holding
+	// whatever its slot held before: a default T, or an item that was popped earlier and then handed
+	// back by pop(), so the buffers that an item owns go round the ring instead of being freed and remade.
+	// Once the queue is closed the item is left alone, and nothing more is queued.
+	bool push(T& item)
+	{
+		unique_lock<mutex> lock(m);
+
+		not_full.wait(lock, [this]() { return count < slots.size() || closed; });
+
+		if (closed)
+			return false;
+
+		std::swap(slots[(first + count) % slots.size()], item);
+		count++;
+
+		not_empty.notify_one();
+
+		return true;
+	}
+
+	// The item that was passed in is swapped into the vacated slot.
+	bool pop(T& item)
+	{
+		unique_lock<mutex> lock(m);
+
+		not_empty.wait(lock, [this]() { return count > 0 || closed; });
+
+		if (0 == count)
+			return false;
+
+		std::swap(item, slots[first]);
+		first = (first + 1) % slots.size();
+		count--;
+
+		not_full.notify_one();
+
+		return true;
+	}
+
+	// Calls prepare(slot) on every slot, so that the items that go round the ring can be given room
+	// up front. Only call it before anything is pushed.
+	template<typename prepare_function>
+	void prepare_slots(prepare_function prepare)
+	{
+		unique_lock<mutex> lock(m);
+
+		for (size_t i = 0; i < slots.size(); i++)
+			prepare(slots[i]);
+	}
+
+	void close(void)
+	{
+		unique_lock<mutex> lock(m);
+
+		closed = true;
+
+		not_empty.notify_all();
+		not_full.notify_all();
+	}
+
+	size_t size(void)
+	{
+		unique_lock<mutex> lock(m);
+
+		return count;
+	}
+
+private:
+	vector<T> slots;
+	size_t first;
+	size_t count;
+	bool closed;
+
+	mutex m;
+	condition_variable not_empty;
+	condition_variable not_full;
+};
+
+
+#endif
@@ -0,0 +1,502 @@
+#include "brick_volume.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+
+static void lz_write_length(vector<char>& dst, size_t length)
+{
+	while (length >= 255)
+	{
+		dst.push_back(static_cast<char>(255));
+		length -= 255;
+	}
+
+	dst.push_back(static_cast<char>(length));
+}
+
+static void lz_write_sequence(vector<char>& dst, const char* const literals, size_t literal_length, size_t offset, size_t match_length)
+{
+	const size_t min_match = 4;
+
+	const size_t literal_token = min(literal_length, static_cast<size_t>(15));
+	const size_t match_token = (0 == match_length) ? 0 : min(match_length - min_match, static_cast<size_t>(15));
+
+	dst.push_back(static_cast<char>((literal_token << 4) | match_token));
+
+	if (literal_token == 15)
+		lz_write_length(dst, literal_length - 15);
+
+	dst.insert(dst.end(), literals, literals + literal_length);
+
+	if (0 == match_length)
+		return;
+
+	dst.push_back(static_cast<char>(offset & 0xff));
+	dst.push_back(static_cast<char>((offset >> 8) & 0xff));
+
+	if (match_token == 15)
+		lz_write_length(dst, match_length - min_match - 15);
+}
+
+void lz_compress(const char* const src, const size_t src_size, vector<char>& dst)
+{
+	const size_t min_match = 4;
+	const size_t max_offset = 65535;
+	const size_t hash_bits = 14;
+	const size_t no_position = static_cast<size_t>(-1);
+
+	dst.clear();
+
+	vector<size_t> table(static_cast<size_t>(1) << hash_bits, no_position);
+
+	size_t anchor = 0;
+	size_t i = 0;
+
+	while (i + min_match <= src_size)
+	{
+		unsigned int bytes;
+		memcpy(&bytes, src + i, sizeof(bytes));
+
+		const size_t h = (bytes * 2654435761u) >> (32 - hash_bits);
+		const size_t candidate = table[h];
+		table[h] = i;
+
+		if (no_position != candidate && i - candidate <= max_offset && 0 == memcmp(src + candidate, src + i, min_match))
+		{
+			size_t length = min_match;
+
+			while (i + length < src_size && src[candidate + length] == src[i + length])
+				length++;
+
+			lz_write_sequence(dst, src + anchor, i - anchor, i - candidate, length);
+
+			i += length;
+			anchor = i;
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	// The final sequence is just literals, possibly none.
+	lz_write_sequence(dst, src + anchor, src_size - anchor, 0, 0);
+}
+
+static bool lz_read_length(const unsigned char*& ip, const unsigned char* const end, size_t& length)
+{
+	unsigned char b;
+
+	do
+	{
+		if (ip >= end)
+			return false;
+
+		b = *ip++;
+		length += b;
+	}
+	while (255 == b);
+
+	return true;
+}
+
+bool lz_decompress(const char* const src, const size_t src_size, char* const dst, const size_t dst_size)
+{
+	const size_t min_match = 4;
+
+	const unsigned char* ip = reinterpret_cast<const unsigned char*>(src);
+	const unsigned char* const end = ip + src_size;
+	size_t op = 0;
+
+	while (ip < end)
+	{
+		const unsigned char token = *ip++;
+
+		size_t literal_length = token >> 4;
+
+		if (15 == literal_length && !lz_read_length(ip, end, literal_length))
+			return false;
+
+		if (literal_length > static_cast<size_t>(end - ip) || literal_length > dst_size - op)
+			return false;
+
+		memcpy(dst + op, ip, literal_length);
+		ip += literal_length;
+		op += literal_length;
+
+		// The last sequence has no back reference.
+		if (ip == end)
+			break;
+
+		if (end - ip < 2)
+			return false;
+
+		const size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		size_t match_length = token & 15;
+
+		if (15 == match_length && !lz_read_length(ip, end, match_length))
+			return false;
+
+		match_length += min_match;
+
+		if (0 == offset || offset > op || match_length > dst_size - op)
+			return false;
+
+		// Byte by byte, since the match may overlap what it is producing.
+		for (size_t i = 0; i < match_length; i++, op++)
+			dst[op] = dst[op - offset];
+	}
+
+	return op == dst_size;
+}
+
+
+
+// Size of the fixed header and of one brick index entry, in bytes.
+static const size_t brick_volume_header_size = 72;
+static const size_t brick_index_entry_size = 24;
+
+// Transposes count floats into four planes of bytes (all first bytes, then all second bytes, ...).
+static void shuffle_floats(const float* const src, size_t count, vector<char>& dst)
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(src);
+	dst.resize(count * sizeof(float));
+
+	for (size_t i = 0; i < count; i++)
+		for (size_t k = 0; k < sizeof(float); k++)
+			dst[k * count + i] = bytes[i * sizeof(float) + k];
+}
+
+static void unshuffle_floats(const vector<char>& src, size_t count, float* const dst)
+{
+	unsigned char* bytes = reinterpret_cast<unsigned char*>(dst);
+
+	for (size_t i = 0; i < count; i++)
+		for (size_t k = 0; k < sizeof(float); k++)
+			bytes[i * sizeof(float) + k] = src[k * count + i];
+}
+
+static size_t get_brick_count(size_t res, size_t brick_size)
+{
+	return (res + brick_size - 1) / brick_size;
+}
+
+bool brick_volume_writer::open(const char* const src_file_name, size_t src_x_res, size_t src_y_res, size_t src_z_res, const float bounds[6], size_t src_brick_size)
+{
+	if (0 == src_brick_size)
+		return false;
+
+	brick_size = src_brick_size;
+	x_res = src_x_res;
+	y_res = src_y_res;
+	z_res = src_z_res;
+	num_planes = 0;
+	num_planes_in_layer = 0;
+	index.clear();
+	layer.resize(brick_size * x_res * y_res);
+
+	file_name = src_file_name;
+	out.open(src_file_name, ios_base::binary);
+
+	if (out.fail())
+		return false;
+
+	// The brick index offset, brick count and final z_res are patched in by close().
+	vector<char> header(brick_volume_header_size, 0);
+	char* cp = &header[0];
+
+	const unsigned int brick_size_32 = static_cast<unsigned int>(brick_size);
+	const unsigned long long res[3] = { x_res, y_res, z_res };
+
+	memcpy(cp, "JBV1", 4); cp += 4;
+	memcpy(cp, &brick_size_32, sizeof(brick_size_32)); cp += sizeof(brick_size_32);
+	memcpy(cp, res, sizeof(res)); cp += sizeof(res);
+	memcpy(cp, bounds, 6 * sizeof(float));
+
+	out.write(&header[0], header.size());
+
+	return !out.fail();
+}
+
+bool brick_volume_writer::append_plane(const float* const plane)
+{
+	if (!out.is_open() || num_planes == z_res)
+		return false;
+
+	const size_t plane_size = x_res * y_res;
+
+	memcpy(&layer[num_planes_in_layer * plane_size], plane, plane_size * sizeof(float));
+	num_planes_in_layer++;
+	num_planes++;
+
+	if (num_planes_in_layer == brick_size)
+		return write_layer();
+
+	return true;
+}
+
+bool brick_volume_writer::write_layer(void)
+{
+	const size_t plane_size = x_res * y_res;
+	const size_t num_bricks_x = get_brick_count(x_res, brick_size);
+	const size_t num_bricks_y = get_brick_count(y_res, brick_size);
+	const size_t nz = num_planes_in_layer;
+
+	for (size_t by = 0; by < num_bricks_y; by++)
+	{
+		for (size_t bx = 0; bx < num_bricks_x; bx++)
+		{
+			const size_t x0 = bx * brick_size;
+			const size_t y0 = by * brick_size;
+			const size_t nx = min(brick_size, x_res - x0);
+			const size_t ny = min(brick_size, y_res - y0);
+
+			// Gather the brick's samples, in plane layout.
+			brick.resize(nx * ny * nz);
+
+			size_t n = 0;
+
+			for (size_t z = 0; z < nz; z++)
+				for (size_t x = 0; x < nx; x++)
+					for (size_t y = 0; y < ny; y++)
+						brick[n++] = layer[z * plane_size + (x0 + x) * y_res + (y0 + y)];
+
+			index_entry entry;
+			entry.offset = static_cast<unsigned long long>(out.tellp());
+			entry.size = 0;
+			entry.encoding = uniform_brick;
+			entry.value = brick[0];
+
+			for (size_t i = 1; i < brick.size(); i++)
+			{
+				// Compare bit patterns, so that NaNs and signed zeros survive too.
+				if (0 != memcmp(&brick[i], &brick[0], sizeof(float)))
+				{
+					entry.encoding = lz_brick;
+					break;
+				}
+			}
+
+			if (lz_brick == entry.encoding)
+			{
+				shuffle_floats(&brick[0], brick.size(), shuffled);
+				lz_compress(&shuffled[0], shuffled.size(), compressed);
+
+				if (compressed.size() < shuffled.size())
+				{
+					out.write(&compressed[0], compressed.size());
+					entry.size = static_cast<unsigned int>(compressed.size());
+				}
+				else
+				{
+					out.write(reinterpret_cast<const char*>(&brick[0]), brick.size() * sizeof(float));
+					entry.encoding = raw_brick;
+					entry.size = static_cast<unsigned int>(brick.size() * sizeof(float));
+				}
+			}
+
+			index.push_back(entry);
+		}
+	}
+
+	num_planes_in_layer = 0;
+
+	return !out.fail();
+}
+
+bool brick_volume_writer::close(void)
+{
+	if (!out.is_open())
+		return false;
+
+	bool ok = true;
+
+	if (num_planes_in_layer > 0)
+		ok = write_layer();
+
+	const unsigned long long index_offset = static_cast<unsigned long long>(out.tellp());
+
+	for (size_t i = 0; i < index.size(); i++)
+	{
+		char entry[brick_index_entry_size] = { 0 };
+
+		memcpy(entry, &index[i].offset, 8);
+		memcpy(entry + 8, &index[i].size, 4);
+		memcpy(entry + 12, &index[i].encoding, 4);
+		memcpy(entry + 16, &index[i].value, 4);
+
+		out.write(entry, brick_index_entry_size);
+	}
+
+	// Only the planes that were actually appended are in the volume.
+	const unsigned long long final_z_res = num_planes;
+	const unsigned long long num_bricks = index.size();
+
+	out.seekp(8 + 2 * sizeof(unsigned long long));
+	out.write(reinterpret_cast<const char*>(&final_z_res), sizeof(final_z_res));
+	out.seekp(8 + 3 * sizeof(unsigned long long) + 6 * sizeof(float));
+	out.write(reinterpret_cast<const char*>(&index_offset), sizeof(index_offset));
+	out.write(reinterpret_cast<const char*>(&num_bricks), sizeof(num_bricks));
+
+	ok = ok && !out.fail();
+	out.close();
+
+	return ok;
+}
+
+void brick_volume_writer::abandon(void)
+{
+	if (out.is_open())
+	{
+		out.close();
+		remove(file_name.c_str());
+	}
+}
+
+
+
+bool brick_volume_reader::open(const char* const file_name)
+{
+	if (false == in.open(file_name))
+		return false;
+
+	if (in.size() < brick_volume_header_size || 0 != memcmp(in.data(), "JBV1", 4))
+	{
+		in.close();
+		return false;
+	}
+
+	const char* cp = in.data() + 4;
+
+	unsigned int brick_size_32;
+	unsigned long long res[3];
+	unsigned long long index_offset;
+	unsigned long long num_bricks;
+
+	memcpy(&brick_size_32, cp, sizeof(brick_size_32)); cp += sizeof(brick_size_32);
+	memcpy(res, cp, sizeof(res)); cp += sizeof(res);
+	memcpy(bounds, cp, sizeof(bounds)); cp += sizeof(bounds);
+	memcpy(&index_offset, cp, sizeof(index_offset)); cp += sizeof(index_offset);
+	memcpy(&num_bricks, cp, sizeof(num_bricks));
+
+	brick_size = brick_size_32;
+	x_res = static_cast<size_t>(res[0]);
+	y_res = static_cast<size_t>(res[1]);
+	z_res = static_cast<size_t>(res[2]);
+
+	if (0 == brick_size)
+	{
+		in.close();
+		return false;
+	}
+
+	num_bricks_x = get_brick_count(x_res, brick_size);
+	num_bricks_y = get_brick_count(y_res, brick_size);
+	num_bricks_z = get_brick_count(z_res, brick_size);
+
+	if (num_bricks != num_bricks_x * num_bricks_y * num_bricks_z ||
+		index_offset > in.size() ||
+		in.size() - index_offset < num_bricks * brick_index_entry_size)
+	{
+		in.close();
+		return false;
+	}
+
+	index = in.data() + index_offset;
+
+	return true;
+}
+
+bool brick_volume_reader::decode_brick(size_t bx, size_t by, size_t bz, vector<float>& samples)
+{
+	const char* entry = index + ((bz * num_bricks_y + by) * num_bricks_x + bx) * brick_index_entry_size;
+
+	unsigned long long offset;
+	unsigned int size;
+	unsigned int encoding;
+	float value;
+
+	memcpy(&offset, entry, 8);
+	memcpy(&size, entry + 8, 4);
+	memcpy(&encoding, entry + 12, 4);
+	memcpy(&value, entry + 16, 4);
+
+	const size_t count = min(brick_size, x_res - bx * brick_size) * min(brick_size, y_res - by * brick_size) * min(brick_size, z_res - bz * brick_size);
+	samples.resize(count);
+
+	if (uniform_brick == encoding)
+	{
+		fill(samples.begin(), samples.end(), value);
+		return true;
+	}
+
+	if (offset > in.size() || size > in.size() - offset)
+		return false;
+
+	const char* data = in.data() + offset;
+
+	if (raw_brick == encoding)
+	{
+		if (size != count * sizeof(float))
+			return false;
+
+		memcpy(&samples[0], data, size);
+
+		return true;
+	}
+
+	if (lz_brick != encoding)
+		return false;
+
+	unshuffled.resize(count * sizeof(float));
+
+	if (false == lz_decompress(data, size, &unshuffled[0], unshuffled.size()))
+		return false;
+
+	unshuffle_floats(unshuffled, count, &samples[0]);
+
+	return true;
+}
+
+bool brick_volume_reader::read_region(size_t x0, size_t y0, size_t z0, size_t nx, size_t ny, size_t nz, vector<float>& region)
+{
+	if (!in.is_open() || x0 + nx > x_res || y0 + ny > y_res || z0 + nz > z_res)
+		return false;
+
+	region.resize(nx * ny * nz);
+
+	if (0 == region.size())
+		return true;
+
+	for (size_t bz = z0 / brick_size; bz <= (z0 + nz - 1) / brick_size; bz++)
+	{
+		for (size_t by = y0 / brick_size; by <= (y0 + ny - 1) / brick_size; by++)
+		{
+			for (size_t bx = x0 / brick_size; bx <= (x0 + nx - 1) / brick_size; bx++)
+			{
+				if (false == decode_brick(bx, by, bz, brick))
+					return false;
+
+				const size_t bx0 = bx * brick_size;
+				const size_t by0 = by * brick_size;
+				const size_t bz0 = bz * brick_size;
+				const size_t bnx = min(brick_size, x_res - bx0);
+				const size_t bny = min(brick_size, y_res - by0);
+				const size_t bnz = min(brick_size, z_res - bz0);
+
+				// Copy the part of the brick that overlaps the region.
+				for (size_t z = max(z0, bz0); z < min(z0 + nz, bz0 + bnz); z++)
+					for (size_t x = max(x0, bx0); x < min(x0 + nx, bx0 + bnx); x++)
+						for (size_t y = max(y0, by0); y < min(y0 + ny, by0 + bny); y++)
+							region[((z - z0) * nx + (x - x0)) * ny + (y - y0)] = brick[((z - bz0) * bnx + (x - bx0)) * bny + (y - by0)];
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,116 @@
+#ifndef BRICK_VOLUME_H
+#define BRICK_VOLUME_H
+
+#include "mapped_file.h"
+
+#include <fstream>
+using std::ofstream;
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+
+// A small self-contained LZ77 codec in the style of LZ4: a sequence of
+// (literal run, back reference) pairs with 4 bit length tokens, 255-byte length extensions,
+// and 16 bit offsets. Fast to decode, and good at the repeated byte patterns of shuffled floats.
+void lz_compress(const char* const src, const size_t src_size, vector<char>& dst);
+
+// Returns false if the data is corrupt or does not decode to exactly dst_size bytes.
+bool lz_decompress(const char* const src, const size_t src_size, char* const dst, const size_t dst_size);
+
+
+// Native compressed field volume (.jbv), made of fixed-size cubic bricks:
+//
+//   char[4]   magic "JBV1"
+//   uint32    brick size (bricks are brick_size^3 samples, clipped at the volume edges)
+//   uint64    x_res, y_res, z_res
+//   float[6]  grid bounds: x min, x max, y min, y max, z min, z max
+//   uint64    offset of the brick index
+//   uint64    number of bricks
+//   ...       brick data
+//   index     per brick, in x, then y, then z order:
+//             uint64 offset, uint32 stored size, uint32 encoding, float uniform value, uint32 reserved
+//
+// A brick whose samples are all equal (e.g. saturated values outside the set) is stored as just
+// its value in the index. The others have their float bytes shuffled into four byte planes and
+// are LZ-compressed, or stored raw if that doesn't help. Samples are laid out as in the xyplane
+// vectors: index (x * y_res + y) within a plane.
+enum brick_encoding { uniform_brick = 0, lz_brick = 1, raw_brick = 2 };
+
+class brick_volume_writer
+{
+public:
+	brick_volume_writer(void) : brick_size(0), x_res(0), y_res(0), z_res(0), num_planes(0), num_planes_in_layer(0) { }
+
+	bool open(const char* const src_file_name, size_t src_x_res, size_t src_y_res, size_t src_z_res, const float bounds[6], size_t src_brick_size = 16);
+
+	// Planes are buffered until a whole layer of bricks is ready to be compressed.
+	bool append_plane(const float* const plane);
+
+	bool close(void);
+
+	// Stops writing and deletes the file.
+	void abandon(void);
+
+	bool is_open(void) const { return out.is_open(); }
+
+private:
+	bool write_layer(void);
+
+	class index_entry
+	{
+	public:
+		unsigned long long offset;
+		unsigned int size;
+		unsigned int encoding;
+		float value;
+	};
+
+	ofstream out;
+	string file_name;
+	size_t brick_size;
+	size_t x_res, y_res, z_res;
+	size_t num_planes;
+	size_t num_planes_in_layer;
+	vector<float> layer;
+	vector<float> brick;
+	vector<char> shuffled;
+	vector<char> compressed;
+	vector<index_entry> index;
+};
+
+class brick_volume_reader
+{
+public:
+	brick_volume_reader(void) : brick_size(0), x_res(0), y_res(0), z_res(0), num_bricks_x(0), num_bricks_y(0), num_bricks_z(0) { }
+
+	bool open(const char* const file_name);
+	void close(void) { in.close(); }
+
+	size_t get_x_res(void) const { return x_res; }
+	size_t get_y_res(void) const { return y_res; }
+	size_t get_z_res(void) const { return z_res; }
+	const float* get_bounds(void) const { return bounds; }
+
+	// Reads the box [x0, x0 + nx) x [y0, y0 + ny) x [z0, z0 + nz) into region, as nz planes of nx * ny
+	// samples laid out like the xyplane vectors. Only the bricks that overlap the box are decoded.
+	bool read_region(size_t x0, size_t y0, size_t z0, size_t nx, size_t ny, size_t nz, vector<float>& region);
+
+private:
+	bool decode_brick(size_t bx, size_t by, size_t bz, vector<float>& samples);
+
+	mapped_file in;
+	size_t brick_size;
+	size_t x_res, y_res, z_res;
+	float bounds[6];
+	size_t num_bricks_x, num_bricks_y, num_bricks_z;
+	const char* index;
+	vector<float> brick;
+	vector<char> unshuffled;
+};
+
+
+#endif
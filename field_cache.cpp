@@ -0,0 +1,217 @@
+#include "field_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+using namespace std;
+
+
+static void hash_bytes(unsigned long long& h, const void* data, size_t size)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+
+	for (size_t i = 0; i < size; i++)
+	{
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+}
+
+static void hash_float(unsigned long long& h, float f)
+{
+	hash_bytes(h, &f, sizeof(float));
+}
+
+static void hash_size(unsigned long long& h, size_t s)
+{
+	// Fixed width, so that 32 and 64-bit builds agree.
+	const unsigned long long u = s;
+	hash_bytes(h, &u, sizeof(u));
+}
+
+unsigned long long field_volume_key::hash(void) const
+{
+	unsigned long long h = 14695981039346656037ULL;
+
+	hash_float(h, C.x);
+	hash_float(h, C.y);
+	hash_float(h, C.z);
+	hash_float(h, C.w);
+	hash_float(h, x_grid_min);
+	hash_float(h, x_grid_max);
+	hash_float(h, y_grid_min);
+	hash_float(h, y_grid_max);
+	hash_float(h, z_grid_min);
+	hash_float(h, z_grid_max);
+	hash_size(h, x_res);
+	hash_size(h, y_res);
+	hash_size(h, z_res);
+	hash_float(h, w);
+	hash_bytes(h, &max_iterations, sizeof(max_iterations));
+	hash_float(h, threshold);
+	hash_bytes(h, &kernel_version, sizeof(kernel_version));
+	hash_bytes(h, &field_mode, sizeof(field_mode));
+
+	return h;
+}
+
+string field_volume_key::get_file_name(void) const
+{
+	ostringstream name;
+	name << "field_" << hex << setw(16) << setfill('0') << hash() << ".vol";
+
+	return name.str();
+}
+
+
+
+// Writes the parts of the key that are not in the fixed header fields, at offset 48 of the header.
+static void encode_key_record(const field_volume_key& key, char* const record)
+{
+	const float floats[11] =
+	{
+		key.C.x, key.C.y, key.C.z, key.C.w,
+		key.x_grid_min, key.x_grid_max,
+		key.y_grid_min, key.y_grid_max,
+		key.z_grid_min, key.z_grid_max,
+		key.w
+	};
+
+	const int max_iterations = key.max_iterations;
+	const unsigned int kernel_version = key.kernel_version;
+	const int field_mode = key.field_mode;
+
+	char* cp = record;
+	memcpy(cp, floats, sizeof(floats)); cp += sizeof(floats);
+	memcpy(cp, &max_iterations, sizeof(max_iterations)); cp += sizeof(max_iterations);
+	memcpy(cp, &key.threshold, sizeof(key.threshold)); cp += sizeof(key.threshold);
+	memcpy(cp, &kernel_version, sizeof(kernel_version)); cp += sizeof(kernel_version);
+	memcpy(cp, &field_mode, sizeof(field_mode));
+}
+
+const size_t key_record_offset = 48;
+const size_t key_record_size = 11 * sizeof(float) + 4 * 4;
+
+
+
+bool field_volume_writer::open(const field_volume_key& key)
+{
+	abandon();
+
+	file_name = key.get_file_name();
+	temp_file_name = file_name + ".tmp";
+	plane_size = key.x_res * key.y_res;
+	num_planes = 0;
+
+	out.open(temp_file_name.c_str(), ios_base::binary);
+
+	if (out.fail())
+		return false;
+
+	vector<char> header(field_volume_header_size, 0);
+	char* cp = &header[0];
+
+	const unsigned int header_size = static_cast<unsigned int>(field_volume_header_size);
+	const unsigned long long values[5] = { key.hash(), key.x_res, key.y_res, key.z_res, 0 };
+
+	memcpy(cp, "JFV2", 4); cp += 4;
+	memcpy(cp, &header_size, sizeof(header_size)); cp += sizeof(header_size);
+	memcpy(cp, values, sizeof(values));
+
+	encode_key_record(key, &header[key_record_offset]);
+
+	out.write(&header[0], header.size());
+
+	return !out.fail();
+}
+
+bool field_volume_writer::append_plane(const float* const plane)
+{
+	if (!out.is_open())
+		return false;
+
+	out.write(reinterpret_cast<const char*>(plane), sizeof(float) * plane_size);
+	num_planes++;
+
+	return !out.fail();
+}
+
+bool field_volume_writer::close(void)
+{
+	if (!out.is_open())
+		return false;
+
+	// Mark the volume as complete.
+	const unsigned long long planes_written = num_planes;
+	out.seekp(8 + 4 * sizeof(unsigned long long));
+	out.write(reinterpret_cast<const char*>(&planes_written), sizeof(planes_written));
+
+	const bool ok = !out.fail();
+	out.close();
+
+	if (!ok)
+	{
+		remove(temp_file_name.c_str());
+		return false;
+	}
+
+	// rename() won't replace an existing file everywhere.
+	remove(file_name.c_str());
+
+	return 0 == rename(temp_file_name.c_str(), file_name.c_str());
+}
+
+void field_volume_writer::abandon(void)
+{
+	if (out.is_open())
+	{
+		out.close();
+		remove(temp_file_name.c_str());
+	}
+}
+
+
+
+bool field_volume_reader::open(const field_volume_key& key)
+{
+	in.close();
+
+	if (false == in.open(key.get_file_name().c_str()))
+		return false;
+
+	plane_size = key.x_res * key.y_res;
+	z_res = key.z_res;
+
+	if (in.size() != field_volume_header_size + sizeof(float) * plane_size * z_res || 0 != memcmp(in.data(), "JFV2", 4))
+	{
+		in.close();
+		return false;
+	}
+
+	unsigned long long values[5];
+	memcpy(values, in.data() + 8, sizeof(values));
+
+	char key_record[key_record_size];
+	encode_key_record(key, key_record);
+
+	// A volume for another key with the same hash, or one that was never finished, must not be used.
+	if (values[0] != key.hash() || values[1] != key.x_res || values[2] != key.y_res || values[3] != key.z_res || values[4] != key.z_res
+		|| 0 != memcmp(in.data() + key_record_offset, key_record, key_record_size))
+	{
+		in.close();
+		return false;
+	}
+
+	return true;
+}
+
+const float* field_volume_reader::get_plane(size_t z) const
+{
+	if (!in.is_open() || z >= z_res)
+		return 0;
+
+	// The 128 byte header keeps every plane 4-byte aligned.
+	return reinterpret_cast<const float*>(in.data() + field_volume_header_size) + z * plane_size;
+}
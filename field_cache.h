@@ -0,0 +1,101 @@
+#ifndef FIELD_CACHE_H
+#define FIELD_CACHE_H
+
+#include "primitives.h"
+#include "mapped_file.h"
+
+#include <fstream>
+using std::ofstream;
+
+#include <string>
+using std::string;
+
+
+// Everything that determines the values of one field volume (one Julia constant, one w slice).
+// Bump kernel_version whenever the shader changes what it computes.
+class field_volume_key
+{
+public:
+	quaternion C;
+	float x_grid_min, x_grid_max;
+	float y_grid_min, y_grid_max;
+	float z_grid_min, z_grid_max;
+	size_t x_res, y_res, z_res;
+	float w;
+	int max_iterations;
+	float threshold;
+	unsigned int kernel_version;
+	int field_mode;
+
+	// 64-bit FNV-1a hash of all of the above.
+	unsigned long long hash(void) const;
+
+	// Cache file name, e.g. field_0123456789abcdef.vol
+	string get_file_name(void) const;
+};
+
+// Cached field volumes are stored as a 128 byte header followed by z_res planes of
+// x_res * y_res floats, one plane per chunk, in the same layout as the xyplane vectors:
+//
+//   char[4]   magic "JFV2"
+//   uint32    header size (128)
+//   uint64    key hash
+//   uint64    x_res, y_res, z_res
+//   uint64    number of planes written; only equal to z_res once the volume is complete
+//   float[4]  C
+//   float[6]  x, y, z grid minimum and maximum
+//   float     w
+//   int32     max iterations
+//   float     threshold
+//   uint32    kernel version
+//   int32     field mode
+//   zero padding up to the header size
+//
+// The whole key is kept, not just its hash, so that two keys with the same hash can be told apart.
+// A volume is written to a temporary file and renamed into place when it is complete,
+// so a run that is interrupted never leaves a partial volume behind to be mistaken for a whole one.
+const size_t field_volume_header_size = 128;
+
+class field_volume_writer
+{
+public:
+	field_volume_writer(void) : num_planes(0), plane_size(0) { }
+	~field_volume_writer(void) { abandon(); }
+
+	bool open(const field_volume_key& key);
+	bool append_plane(const float* const plane);
+	bool close(void);
+
+	// Stops writing and deletes the temporary file.
+	void abandon(void);
+
+	bool is_open(void) const { return out.is_open(); }
+
+private:
+	ofstream out;
+	string file_name;
+	string temp_file_name;
+	size_t num_planes;
+	size_t plane_size;
+};
+
+// Memory-maps a complete cached volume, so that planes can be handed straight to marching cubes.
+class field_volume_reader
+{
+public:
+	field_volume_reader(void) : plane_size(0), z_res(0) { }
+
+	// Returns false if there is no complete volume for this key.
+	bool open(const field_volume_key& key);
+	void close(void) { in.close(); }
+
+	const float* get_plane(size_t z) const;
+
+private:
+	mapped_file in;
+	size_t plane_size;
+	size_t z_res;
+};
+
+
+#endif
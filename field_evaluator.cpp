@@ -0,0 +1,219 @@
+#include "field_evaluator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+using namespace std;
+
+
+float get_default_isovalue(field_mode mode, float threshold, int max_iterations, float min_step_size)
+{
+	if (potential_field == mode)
+		return logf(threshold) / powf(2.0f, static_cast<float>(max_iterations));
+	else if (distance_field == mode)
+		return 0.5f * min_step_size;
+	else
+		return threshold;
+}
+
+float get_in_set_bound(field_mode mode, float threshold, int max_iterations)
+{
+	if (distance_field == mode)
+		return FLT_MIN;
+	else
+		return get_default_isovalue(mode, threshold, max_iterations, 0);
+}
+
+
+cpu_field_evaluator::cpu_field_evaluator(const vector<quaternion>& src_C_batch, int src_max_iterations, float src_threshold, field_mode src_mode)
+	: C_batch(src_C_batch), max_iterations(src_max_iterations), threshold(src_threshold), mode(src_mode)
+{
+}
+
+void cpu_field_evaluator::set_field(const vector<quaternion>& src_C_batch, int src_max_iterations, float src_threshold, field_mode src_mode)
+{
+	C_batch = src_C_batch;
+	max_iterations = src_max_iterations;
+	threshold = src_threshold;
+	mode = src_mode;
+}
+
+bool cpu_field_evaluator::evaluate(const vector<float>& points, vector<orbit_summary>& orbits, vector<float>& fields)
+{
+	const size_t num_points = points.size() / 4;
+	const size_t num_records = num_points * C_batch.size();
+
+	orbits.resize(num_records);
+	fields.resize(num_records);
+
+	auto evaluate_records = [&](size_t begin, size_t end)
+	{
+		for (size_t r = begin; r < end; r++)
+		{
+			// Instance-major, so record r belongs to constant r / num_points and point r % num_points.
+			const float* p = &points[4 * (r % num_points)];
+
+			fields[r] = evaluate_point(quaternion(p[0], p[1], p[2], p[3]), C_batch[r / num_points], orbits[r]);
+		}
+	};
+
+	workers.run(num_records, evaluate_records);
+
+	return true;
+}
+
+float cpu_field_evaluator::evaluate_point(const quaternion& position, const quaternion& C, orbit_summary& orbit) const
+{
+	quaternion Z = position;
+
+	int length = 1;
+	int escape_iteration = -1;
+	float dz = 1.0f;
+
+	float min_self_dot = Z.self_dot();
+	float max_self_dot = min_self_dot;
+
+	for (int i = 0; i < max_iterations; i++)
+	{
+		dz = 2.0f * Z.magnitude() * dz;
+
+		// Z^2 by the same polar formula as pow_vec4() in the shader. The cosine of the angle
+		// is clamped, since rounding can push it just past 1, where the shader's acos() is undefined.
+		quaternion Z_squared;
+		const float self_dot = Z.self_dot();
+
+		if (self_dot != 0)
+		{
+			const float len = sqrtf(self_dot);
+			const float angle = 2.0f * acosf(min(max(Z.x / len, -1.0f), 1.0f));
+			const float imaginary_scale = self_dot * sinf(angle) / sqrtf(Z.y * Z.y + Z.z * Z.z + Z.w * Z.w);
+
+			Z_squared = quaternion(self_dot * cosf(angle), Z.y * imaginary_scale, Z.z * imaginary_scale, Z.w * imaginary_scale);
+		}
+
+		Z = Z_squared + C;
+		length++;
+
+		const float self_dot_after = Z.self_dot();
+
+		min_self_dot = min(min_self_dot, self_dot_after);
+		max_self_dot = max(max_self_dot, self_dot_after);
+
+		if (Z.magnitude() >= threshold)
+		{
+			escape_iteration = i + 1;
+			break;
+		}
+	}
+
+	orbit.escape_iteration = (escape_iteration >= 0) ? escape_iteration : 0;
+	orbit.min_magnitude = sqrtf(min_self_dot);
+	orbit.max_magnitude = sqrtf(max_self_dot);
+
+	const float r = max(Z.magnitude(), 1e-30f);
+
+	if (potential_field == mode)
+		return logf(r) / exp2f(static_cast<float>(length - 1));
+	else if (distance_field == mode)
+		return (escape_iteration >= 0 && dz > 0.0f) ? 0.5f * r * logf(r) / dz : 0.0f;
+	else
+		return Z.magnitude();
+}
+
+
+field_evaluator* select_fastest_field_evaluator(const vector<field_evaluator*>& evaluators, const vector<float>& sample_points)
+{
+	field_evaluator* fastest = 0;
+	double fastest_seconds = 0;
+
+	vector<orbit_summary> orbits;
+	vector<float> fields;
+
+	for (size_t i = 0; i < evaluators.size(); i++)
+	{
+		if (false == evaluators[i]->evaluate(sample_points, orbits, fields))
+		{
+			cout << evaluators[i]->get_name() << " evaluator failed; not using it" << endl;
+			continue;
+		}
+
+		const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		if (false == evaluators[i]->evaluate(sample_points, orbits, fields))
+		{
+			cout << evaluators[i]->get_name() << " evaluator failed; not using it" << endl;
+			continue;
+		}
+
+		const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		cout << evaluators[i]->get_name() << " evaluator: " << seconds * 1000.0 << " ms for " << sample_points.size() / 4 << " sample points" << endl;
+
+		if (0 == fastest || seconds < fastest_seconds)
+		{
+			fastest = evaluators[i];
+			fastest_seconds = seconds;
+		}
+	}
+
+	return fastest;
+}
+
+bool check_field_evaluator_conformance(const vector<field_evaluator*>& evaluators, const vector<float>& sample_points, float tolerance, float max_mismatch_fraction)
+{
+	if (evaluators.empty())
+		return false;
+
+	vector<orbit_summary> reference_orbits;
+	vector<float> reference_fields;
+
+	if (false == evaluators[0]->evaluate(sample_points, reference_orbits, reference_fields))
+	{
+		cout << evaluators[0]->get_name() << " evaluator failed" << endl;
+		return false;
+	}
+
+	bool conforms = true;
+
+	vector<orbit_summary> orbits;
+	vector<float> fields;
+
+	for (size_t i = 1; i < evaluators.size(); i++)
+	{
+		if (false == evaluators[i]->evaluate(sample_points, orbits, fields) || fields.size() != reference_fields.size())
+		{
+			cout << evaluators[i]->get_name() << " evaluator failed" << endl;
+			conforms = false;
+			continue;
+		}
+
+		size_t num_mismatches = 0;
+		float max_error = 0;
+
+		for (size_t j = 0; j < fields.size(); j++)
+		{
+			const float a = reference_fields[j];
+			const float b = fields[j];
+			const float error = fabsf(a - b) / max(1.0f, max(fabsf(a), fabsf(b)));
+
+			// NaN compares false, so it has to be caught separately.
+			if (false == (error <= tolerance) || orbits[j].escape_iteration != reference_orbits[j].escape_iteration)
+				num_mismatches++;
+			else if (error > max_error)
+				max_error = error;
+		}
+
+		const bool ok = num_mismatches <= max_mismatch_fraction * fields.size();
+
+		cout << evaluators[i]->get_name() << " vs. " << evaluators[0]->get_name() << ": "
+			<< num_mismatches << " of " << fields.size() << " field value(s) disagree, largest other relative error "
+			<< max_error << (ok ? " (pass)" : " (FAIL)") << endl;
+
+		if (false == ok)
+			conforms = false;
+	}
+
+	return conforms;
+}
@@ -0,0 +1,110 @@
+#ifndef FIELD_EVALUATOR_H
+#define FIELD_EVALUATOR_H
+
+#include "primitives.h"
+#include "worker_pool.h"
+
+#include <vector>
+using std::vector;
+
+
+// Limits on how much memory the evaluator may use at once.
+class memory_budget
+{
+public:
+	size_t device_bytes; // Largest transform feedback buffer to allocate for one sub-dispatch.
+	size_t host_bytes; // Largest amount of host memory to hold read-back orbit summaries and fields in.
+};
+
+// What the field handed to marching cubes holds for each lattice point.
+enum field_mode
+{
+	// Magnitude of the last orbit point. Strongly non-linear near the surface.
+	magnitude_field,
+
+	// Smooth escape potential log|Z_n| / 2^n, after n iterations. It is below
+	// log(threshold) / 2^max_iterations exactly where the magnitude field is below threshold,
+	// but it varies smoothly across the escape-count bands, so it interpolates well.
+	potential_field,
+
+	// Distance estimate 0.5 |Z| log|Z| / |Z'| from the derivative orbit, or 0 for points that
+	// did not escape. Roughly the distance to the set, so linear interpolation suits it.
+	distance_field
+};
+
+// The isovalue that makes each kind of field give the same surface as the magnitude field
+// with isovalue threshold. For the distance field, which has no exact equivalent,
+// the surface is put half a grid step out from the set.
+float get_default_isovalue(field_mode mode, float threshold, int max_iterations, float min_step_size);
+
+// Points whose field value is below this bound did not escape.
+// Points that did not escape have a distance estimate of exactly 0.
+float get_in_set_bound(field_mode mode, float threshold, int max_iterations);
+
+
+// What is kept of the orbit of an evaluated point: as much as the render statistics need,
+// gathered as the point is iterated, so that the orbit itself is never stored.
+class orbit_summary
+{
+public:
+	unsigned int escape_iteration; // the iteration on which the orbit escaped, or 0 if it never did
+	float min_magnitude; // smallest and largest magnitude anywhere along the orbit, starting point included
+	float max_magnitude;
+};
+
+// Evaluates lattice points against a batch of Julia constants.
+// Every backend computes the same orbits, so their fields agree to within rounding.
+class field_evaluator
+{
+public:
+	virtual ~field_evaluator(void) { }
+
+	virtual const char* get_name(void) const = 0;
+
+	// Changes the field that is evaluated, without remaking anything. There must be as many
+	// Julia constants as the evaluator was made with.
+	virtual void set_field(const vector<quaternion>& src_C_batch, int src_max_iterations, float src_threshold, field_mode src_mode) = 0;
+
+	// Evaluates every point (packed as x, y, z, w) against every Julia constant. The orbit summaries,
+	// and each point's field value, replace what they held, instance-major: all of the points for
+	// the first constant, then all of the points for the second, and so on.
+	// Returns false (leaving orbits in an unspecified state) if the evaluation fails.
+	virtual bool evaluate(const vector<float>& points, vector<orbit_summary>& orbits, vector<float>& fields) = 0;
+};
+
+// Runs the same iteration as the geometry shader, in single precision, on all hardware threads.
+// Needs no GL context, so it is always available.
+class cpu_field_evaluator : public field_evaluator
+{
+public:
+	cpu_field_evaluator(const vector<quaternion>& src_C_batch, int src_max_iterations, float src_threshold, field_mode src_mode);
+
+	const char* get_name(void) const { return "CPU"; }
+	void set_field(const vector<quaternion>& src_C_batch, int src_max_iterations, float src_threshold, field_mode src_mode);
+	bool evaluate(const vector<float>& points, vector<orbit_summary>& orbits, vector<float>& fields);
+
+private:
+	// Iterates one point against one constant, just as the geometry shader does.
+	float evaluate_point(const quaternion& position, const quaternion& C, orbit_summary& orbit) const;
+
+	vector<quaternion> C_batch;
+	int max_iterations;
+	float threshold;
+	field_mode mode;
+
+	worker_pool workers;
+};
+
+// Times each evaluator on the sample points, after one untimed run to warm it up,
+// and returns the fastest. Evaluators that fail are skipped; returns 0 if they all fail.
+field_evaluator* select_fastest_field_evaluator(const vector<field_evaluator*>& evaluators, const vector<float>& sample_points);
+
+// Checks that every evaluator agrees with the first one on the sample points.
+// Field values agree if they are within tolerance of each other, relative to the larger
+// of 1 and their magnitudes. Points right on the escape threshold can escape for one backend and
+// not another, which changes their field completely, so up to max_mismatch_fraction of the points
+// may disagree. Prints a line per evaluator, and returns false if any of them does not conform.
+bool check_field_evaluator_conformance(const vector<field_evaluator*>& evaluators, const vector<float>& sample_points, float tolerance, float max_mismatch_fraction);
+
+
+#endif
@@ -0,0 +1,257 @@
+#include "gl_context.h"
+
+#include <GL/glew.h>
+#include <GL/glut.h>
+
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <cstdlib>
+#include <iostream>
+using namespace std;
+
+
+gl_context::gl_context(void)
+	: current_backend(auto_gl_context), egl_display(0), egl_surface(0), egl_context(0), framebuffer(0), renderbuffer(0), glut_window(0)
+{
+}
+
+bool gl_context::create(int& argc, char** argv, gl_context_backend backend)
+{
+	destroy();
+
+	if (egl_gl_context == backend || auto_gl_context == backend)
+	{
+		if (create_egl())
+		{
+			current_backend = egl_gl_context;
+
+			if (check_version())
+				return true;
+
+			destroy();
+			return false;
+		}
+
+		if (egl_gl_context == backend)
+		{
+			cout << "Couldn't create a headless EGL context" << endl;
+			return false;
+		}
+	}
+
+#ifndef _WIN32
+	// freeglut exits the process if it cannot open a display, so don't let it try.
+	if (0 == getenv("DISPLAY"))
+	{
+		cout << "No headless EGL context, and no display for a GLUT window" << endl;
+		return false;
+	}
+#endif
+
+	if (false == create_glut(argc, argv))
+	{
+		cout << "Couldn't create a GLUT window" << endl;
+		return false;
+	}
+
+	current_backend = glut_gl_context;
+
+	if (check_version())
+		return true;
+
+	destroy();
+	return false;
+}
+
+void gl_context::destroy(void)
+{
+#ifndef _WIN32
+	if (egl_gl_context == current_backend)
+	{
+		if (0 != framebuffer)
+			glDeleteFramebuffers(1, &framebuffer);
+
+		if (0 != renderbuffer)
+			glDeleteRenderbuffers(1, &renderbuffer);
+
+		eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+		if (0 != egl_surface)
+			eglDestroySurface(egl_display, egl_surface);
+
+		eglDestroyContext(egl_display, egl_context);
+		eglTerminate(egl_display);
+	}
+#endif
+
+	if (glut_gl_context == current_backend)
+		glutDestroyWindow(glut_window);
+
+	current_backend = auto_gl_context;
+	egl_display = 0;
+	egl_surface = 0;
+	egl_context = 0;
+	framebuffer = 0;
+	renderbuffer = 0;
+	glut_window = 0;
+}
+
+const char* gl_context::get_backend_name(void) const
+{
+	switch (current_backend)
+	{
+	case egl_gl_context:
+		return "headless EGL";
+	case glut_gl_context:
+		return "GLUT";
+	default:
+		return "none";
+	}
+}
+
+bool gl_context::create_egl(void)
+{
+#ifdef _WIN32
+	return false;
+#else
+	// Prefer Mesa's surfaceless platform, which needs no window system at all.
+	EGLDisplay display = EGL_NO_DISPLAY;
+
+#if defined(EGL_VERSION_1_5) && defined(EGL_PLATFORM_SURFACELESS_MESA)
+	display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+#endif
+
+	if (EGL_NO_DISPLAY == display)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major_version = 0;
+	EGLint minor_version = 0;
+
+	if (EGL_NO_DISPLAY == display || EGL_FALSE == eglInitialize(display, &major_version, &minor_version))
+		return false;
+
+	if (EGL_FALSE == eglBindAPI(EGL_OPENGL_API))
+	{
+		eglTerminate(display);
+		return false;
+	}
+
+	// A 1x1 pbuffer if the display has a config for one; otherwise no config and no surface at all.
+	const EGLint config_attributes[] =
+	{
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+
+	EGLConfig config = 0;
+	EGLint num_configs = 0;
+
+	if (EGL_FALSE == eglChooseConfig(display, config_attributes, &config, 1, &num_configs))
+		num_configs = 0;
+
+	const EGLint context_attributes[] =
+	{
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_NONE
+	};
+
+	EGLContext context = eglCreateContext(display, (num_configs > 0) ? config : static_cast<EGLConfig>(0), EGL_NO_CONTEXT, context_attributes);
+
+	if (EGL_NO_CONTEXT == context)
+	{
+		eglTerminate(display);
+		return false;
+	}
+
+	EGLSurface surface = EGL_NO_SURFACE;
+
+	if (num_configs > 0)
+	{
+		const EGLint surface_attributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		surface = eglCreatePbufferSurface(display, config, surface_attributes);
+	}
+
+	if (EGL_FALSE == eglMakeCurrent(display, surface, surface, context))
+	{
+		if (EGL_NO_SURFACE != surface)
+			eglDestroySurface(display, surface);
+
+		eglDestroyContext(display, context);
+		eglTerminate(display);
+		return false;
+	}
+
+	egl_display = display;
+	egl_surface = (EGL_NO_SURFACE == surface) ? 0 : surface;
+	egl_context = context;
+
+	glewExperimental = GL_TRUE;
+
+	if (GLEW_OK != glewInit())
+	{
+		current_backend = egl_gl_context;
+		destroy();
+		return false;
+	}
+
+	// Without a surface there is no default framebuffer, and draws fail as incomplete.
+	if (0 == egl_surface)
+	{
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+		glGenRenderbuffers(1, &renderbuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 1, 1);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+	}
+
+	return true;
+#endif
+}
+
+bool gl_context::create_glut(int& argc, char** argv)
+{
+	glutInit(&argc, argv);
+	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
+	glutInitWindowSize(10, 10);
+	glutInitWindowPosition(0, 0);
+
+	glut_window = glutCreateWindow("GS Test");
+
+	if (0 == glut_window)
+		return false;
+
+	if (GLEW_OK != glewInit())
+	{
+		cout << "GLEW initialization error" << endl;
+		glutDestroyWindow(glut_window);
+		glut_window = 0;
+		return false;
+	}
+
+	return true;
+}
+
+bool gl_context::check_version(void)
+{
+	int GL_major_version = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &GL_major_version);
+
+	int GL_minor_version = 0;
+	glGetIntegerv(GL_MINOR_VERSION, &GL_minor_version);
+
+	if (GL_major_version < 4 || (GL_major_version == 4 && GL_minor_version < 3))
+	{
+		cout << "GPU does not support OpenGL 4.3 or higher" << endl;
+		return false;
+	}
+
+	return true;
+}
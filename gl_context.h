@@ -0,0 +1,58 @@
+#ifndef GL_CONTEXT_H
+#define GL_CONTEXT_H
+
+#include <string>
+using std::string;
+
+
+enum gl_context_backend
+{
+	// Headless EGL if it is available, which it is wherever Mesa is installed, even without a GPU
+	// (it falls back to the llvmpipe software rasterizer). Otherwise a hidden GLUT window,
+	// as long as there is a display to open it on.
+	auto_gl_context,
+
+	// EGL with no window system. Rendering goes to a 1x1 pbuffer, or to a 1x1 framebuffer object
+	// if the display has no config for a pbuffer.
+	egl_gl_context,
+
+	// A tiny GLUT window, which needs a display.
+	glut_gl_context
+};
+
+// An OpenGL 4.3 context made current on the calling thread, with GLEW initialized.
+// The evaluator only needs transform feedback, so there is never anything on screen.
+class gl_context
+{
+public:
+	gl_context(void);
+	~gl_context(void) { destroy(); }
+
+	// argc and argv are only used by GLUT. Prints a message and returns false on failure.
+	bool create(int& argc, char** argv, gl_context_backend backend = auto_gl_context);
+	void destroy(void);
+
+	bool is_current(void) const { return egl_gl_context == current_backend || glut_gl_context == current_backend; }
+	const char* get_backend_name(void) const;
+
+private:
+	gl_context(const gl_context&);
+	gl_context& operator=(const gl_context&);
+
+	bool create_egl(void);
+	bool create_glut(int& argc, char** argv);
+	bool check_version(void);
+
+	// auto_gl_context until a context has been created.
+	gl_context_backend current_backend;
+
+	void* egl_display;
+	void* egl_surface;
+	void* egl_context;
+	unsigned int framebuffer;
+	unsigned int renderbuffer;
+	int glut_window;
+};
+
+
+#endif
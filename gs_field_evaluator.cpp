@@ -0,0 +1,397 @@
+#include "gs_field_evaluator.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+using namespace std;
+
+
+size_t get_feedback_bytes_per_point(size_t num_constants)
+{
+	return sizeof(GLfloat) * 4 * num_constants;
+}
+
+size_t get_points_per_dispatch(const memory_budget& budget, size_t num_constants)
+{
+	const size_t bytes_per_point = get_feedback_bytes_per_point(num_constants);
+
+	return min(budget.device_bytes / bytes_per_point, budget.host_bytes / (2 * bytes_per_point));
+}
+
+// Unpacks the records written by the geometry shader, one vec4(escape iteration, smallest magnitude,
+// largest magnitude, field value) per point. Record r is unpacked into orbits[index_of(r)] and fields[index_of(r)].
+// Since every record can be found directly, the work is split over the worker threads.
+template<typename index_function>
+void unpack_orbit_records(worker_pool& workers, const vector<GLfloat>& feedback, size_t num_records, index_function index_of, vector<orbit_summary>& orbits, vector<float>& fields)
+{
+	auto unpack_records = [&](size_t begin, size_t end)
+	{
+		for (size_t r = begin; r < end; r++)
+		{
+			const GLfloat* record = &feedback[4 * r];
+			const size_t index = index_of(r);
+
+			orbits[index].escape_iteration = static_cast<unsigned int>(record[0]);
+			orbits[index].min_magnitude = record[1];
+			orbits[index].max_magnitude = record[2];
+			fields[index] = record[3];
+		}
+	};
+
+	workers.run(num_records, unpack_records);
+}
+
+void emit_shaders(ostream& vs_out, ostream& gs_out, size_t num_constants)
+{
+	vs_out << "#version 410 core" << endl;
+
+	vs_out << "// Per-vertex inputs" << endl;
+	vs_out << "layout(location = 0) in vec4 position;" << endl;
+
+	vs_out << "out VS_OUT" << endl;
+	vs_out << "{" << endl;
+	vs_out << "	vec4 position; " << endl;
+	vs_out << "	flat int instance; " << endl;
+	vs_out << "} vs_out;" << endl;
+
+	vs_out << "void main(void)" << endl;
+	vs_out << "{" << endl;
+	vs_out << "	vs_out.position = position; " << endl;
+	vs_out << "	vs_out.instance = gl_InstanceID; " << endl;
+	vs_out << "}" << endl;
+
+	gs_out << "#version 430 core" << endl;
+	gs_out << "" << endl;
+	gs_out << "layout (points) in;" << endl;
+	gs_out << "layout (points) out;" << endl;
+	gs_out << "layout (max_vertices = 1) out;" << endl;
+	gs_out << "" << endl;
+	gs_out << "uniform vec4 C[" << num_constants << "];" << endl;
+	gs_out << "uniform int max_iterations;" << endl;
+	gs_out << "uniform float threshold;" << endl;
+	gs_out << "uniform int field_mode; // as in field_evaluator.h: 0 magnitude, 1 potential, 2 distance" << endl;
+	gs_out << "" << endl;
+	gs_out << "out vec4 vert;" << endl;
+	gs_out << "" << endl;
+	gs_out << "in VS_OUT" << endl;
+	gs_out << "{" << endl;
+	gs_out << "    vec4 position;" << endl;
+	gs_out << "    flat int instance;" << endl;
+	gs_out << "} gs_in[];" << endl;
+	gs_out << "" << endl;
+	gs_out << "vec4 inverse_vec4(vec4 in_vec)" << endl;
+	gs_out << "{" << endl;
+	gs_out << "	// inv(a) = conjugate(a) / norm(a)" << endl;
+	gs_out << "" << endl;
+	gs_out << "	float temp_a_norm = in_vec.x*in_vec.x + in_vec.y*in_vec.y + in_vec.z*in_vec.z + in_vec.w*in_vec.w;" << endl;
+	gs_out << "" << endl;
+	gs_out << "    vec4 out_vec;" << endl;
+	gs_out << "" << endl;
+	gs_out << "	out_vec.x =  in_vec.x;" << endl;
+	gs_out << "	out_vec.y = -in_vec.y;" << endl;
+	gs_out << "	out_vec.z = -in_vec.z;" << endl;
+	gs_out << "	out_vec.w = -in_vec.w;" << endl;
+	gs_out << "" << endl;
+	gs_out << "" << endl;
+	gs_out << "	out_vec.x = out_vec.x / temp_a_norm;" << endl;
+	gs_out << "    out_vec.y = out_vec.y / temp_a_norm;" << endl;
+	gs_out << "	out_vec.z = out_vec.z / temp_a_norm;" << endl;
+	gs_out << "	out_vec.w = out_vec.w / temp_a_norm;" << endl;
+	gs_out << "" << endl;
+	gs_out << "    return out_vec;" << endl;
+	gs_out << "}" << endl;
+	gs_out << "" << endl;
+	gs_out << "vec4 pow_vec4(vec4 in_vec, float beta)" << endl;
+	gs_out << "{" << endl;
+	gs_out << "	float fabs_beta = abs(beta);" << endl;
+	gs_out << "" << endl;
+	gs_out << "	float self_dot = in_vec.x * in_vec.x + in_vec.y * in_vec.y + in_vec.z * in_vec.z + in_vec.w * in_vec.w;" << endl;
+	gs_out << "" << endl;
+	gs_out << "	if (self_dot == 0)" << endl;
+	gs_out << "	{" << endl;
+	gs_out << "        return vec4(0, 0, 0, 0);" << endl;
+	gs_out << "	}" << endl;
+	gs_out << "" << endl;
+	gs_out << "	float len = sqrt(self_dot);" << endl;
+	gs_out << "	float self_dot_beta = pow(self_dot, fabs_beta / 2.0f);" << endl;
+	gs_out << "" << endl;
+	gs_out << "	vec4 out_vec;" << endl;
+	gs_out << "" << endl;
+	gs_out << "	out_vec.x = self_dot_beta * cos(fabs_beta * acos(in_vec.x / len));" << endl;
+	gs_out << "	out_vec.y = in_vec.y * self_dot_beta * sin(fabs_beta * acos(in_vec.x / len)) / sqrt(in_vec.y * in_vec.y + in_vec.z * in_vec.z + in_vec.w * in_vec.w);" << endl;
+	gs_out << "	out_vec.z = in_vec.z * self_dot_beta * sin(fabs_beta * acos(in_vec.x / len)) / sqrt(in_vec.y * in_vec.y + in_vec.z * in_vec.z + in_vec.w * in_vec.w);" << endl;
+	gs_out << "	out_vec.w = in_vec.w * self_dot_beta * sin(fabs_beta * acos(in_vec.x / len)) / sqrt(in_vec.y * in_vec.y + in_vec.z * in_vec.z + in_vec.w * in_vec.w);" << endl;
+	gs_out << "" << endl;
+	gs_out << "	if (beta < 0)" << endl;
+	gs_out << "		out_vec = inverse_vec4(out_vec);" << endl;
+	gs_out << "" << endl;
+	gs_out << "	return out_vec;" << endl;
+	gs_out << "}" << endl;
+	gs_out << "" << endl;
+	gs_out << "" << endl;
+	gs_out << "void main(void)" << endl;
+	gs_out << "{" << endl;
+	gs_out << "    vec4 Z = gs_in[0].position;" << endl;
+	gs_out << "    vec4 Cv = C[gs_in[0].instance];" << endl;
+	gs_out << "		" << endl;
+	gs_out << "    // Every point writes a single vec4(escape iteration, smallest magnitude, largest magnitude, field) record." << endl;
+	gs_out << "    // The orbit is only summarised as it goes, so it is never written out." << endl;
+	gs_out << "    int len = 1;" << endl;
+	gs_out << "    int escape_iteration = 0;" << endl;
+	gs_out << "    float dz = 1.0;" << endl;
+	gs_out << "    float min_self_dot = dot(Z, Z);" << endl;
+	gs_out << "    float max_self_dot = min_self_dot;" << endl;
+	gs_out << "" << endl;
+	gs_out << "    for (int i = 0; i < max_iterations; i++)" << endl;
+	gs_out << "    {" << endl;
+	gs_out << "        dz = 2.0 * length(Z) * dz;" << endl;
+	gs_out << "        Z = pow_vec4(Z, 2.0) + Cv;" << endl;
+	gs_out << "        len++;" << endl;
+	gs_out << "        " << endl;
+	gs_out << "        min_self_dot = min(min_self_dot, dot(Z, Z));" << endl;
+	gs_out << "        max_self_dot = max(max_self_dot, dot(Z, Z));" << endl;
+	gs_out << "        " << endl;
+	gs_out << "        if (length(Z) >= threshold)" << endl;
+	gs_out << "        {" << endl;
+	gs_out << "            escape_iteration = i + 1;" << endl;
+	gs_out << "            break;" << endl;
+	gs_out << "        }" << endl;
+	gs_out << "    }" << endl;
+	gs_out << "" << endl;
+	gs_out << "    float r = max(length(Z), 1e-30);" << endl;
+	gs_out << "    float field = length(Z);" << endl;
+	gs_out << "" << endl;
+	gs_out << "    if (field_mode == 1)" << endl;
+	gs_out << "        field = log(r) / exp2(float(len - 1));" << endl;
+	gs_out << "    else if (field_mode == 2)" << endl;
+	gs_out << "        field = (escape_iteration > 0 && dz > 0.0) ? 0.5 * r * log(r) / dz : 0.0;" << endl;
+	gs_out << "" << endl;
+	gs_out << "    vert = vec4(float(escape_iteration), sqrt(min_self_dot), sqrt(max_self_dot), field);" << endl;
+	gs_out << "    EmitVertex();" << endl;
+	gs_out << "    EndPrimitive();" << endl;
+	gs_out << "}" << endl;
+}
+
+
+gs_field_evaluator::gs_field_evaluator(const vector<quaternion>& src_C_batch, int src_max_iterations, float src_threshold, field_mode src_mode, const memory_budget& src_budget)
+	: C_batch(src_C_batch), max_iterations(src_max_iterations), threshold(src_threshold), mode(src_mode), budget(src_budget),
+	point_buffer(0), point_buffer_bytes(0), feedback_buffer(0), feedback_buffer_bytes(0), query(0)
+{
+}
+
+gs_field_evaluator::~gs_field_evaluator(void)
+{
+	if (0 != query)
+		glDeleteQueries(1, &query);
+
+	if (0 != feedback_buffer)
+		glDeleteBuffers(1, &feedback_buffer);
+
+	if (0 != point_buffer)
+		glDeleteBuffers(1, &point_buffer);
+}
+
+// The constants, iteration count, threshold and field mode are all uniforms, so only the number of
+// constants is compiled into the shaders.
+void gs_field_evaluator::set_field(const vector<quaternion>& src_C_batch, int src_max_iterations, float src_threshold, field_mode src_mode)
+{
+	C_batch = src_C_batch;
+	max_iterations = src_max_iterations;
+	threshold = src_threshold;
+	mode = src_mode;
+}
+
+bool gs_field_evaluator::init(void)
+{
+	GLint max_gs_uniform_components = 0;
+	glGetIntegerv(GL_MAX_GEOMETRY_UNIFORM_COMPONENTS, &max_gs_uniform_components);
+
+	if (C_batch.size() * 4 + 16 > static_cast<size_t>(max_gs_uniform_components))
+	{
+		cout << "Too many Julia constants in one batch" << endl;
+		return false;
+	}
+
+	// Compiled straight from memory, so that nothing is written into the working directory.
+	ostringstream vs_source;
+	ostringstream gs_source;
+
+	emit_shaders(vs_source, gs_source, C_batch.size());
+
+	if (false == g0_mc_shader.init_from_sources(vs_source.str(), gs_source.str(), "vert"))
+	{
+		cout << "Couldn't load shaders" << endl;
+		return false;
+	}
+
+	g0_mc_shader.use_program();
+
+	return true;
+}
+
+// Evaluates every point against every Julia constant in C_batch using instanced draws.
+// If the transform feedback output would not fit in the memory budget, the points are split
+// into as many sub-dispatches as needed, and the results are put back in the same order.
+// The buffers are kept from one call to the next, and only remade when they have to grow.
+bool gs_field_evaluator::evaluate(const vector<float>& point_vertex_data, vector<orbit_summary>& orbits, vector<float>& fields)
+{
+	const GLuint components_per_position = 4;
+	const GLuint components_per_vertex = components_per_position;
+
+	const GLuint num_vertices = static_cast<GLuint>(point_vertex_data.size()) / components_per_vertex;
+	const GLsizei num_instances = static_cast<GLsizei>(C_batch.size());
+
+	const size_t points_per_dispatch = get_points_per_dispatch(budget, C_batch.size());
+
+	if (0 == points_per_dispatch)
+	{
+		cerr << "Memory budget is too small to evaluate even one point ("
+			<< get_feedback_bytes_per_point(C_batch.size()) << " bytes of transform feedback per point)" << endl;
+
+		return false;
+	}
+
+	// Drain any stale errors so that the checks below only see our own.
+	while (GL_NO_ERROR != glGetError())
+		;
+
+	const size_t point_bytes = point_vertex_data.size() * sizeof(GLfloat);
+
+	if (0 == point_buffer)
+		glGenBuffers(1, &point_buffer);
+
+	glBindBuffer(GL_ARRAY_BUFFER, point_buffer);
+
+	if (point_bytes > point_buffer_bytes)
+	{
+		glBufferData(GL_ARRAY_BUFFER, point_bytes, &point_vertex_data[0], GL_DYNAMIC_DRAW);
+		point_buffer_bytes = point_bytes;
+	}
+	else
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, 0, point_bytes, &point_vertex_data[0]);
+	}
+
+	glEnableVertexAttribArray(glGetAttribLocation(g0_mc_shader.get_program(), "position"));
+	glVertexAttribPointer(glGetAttribLocation(g0_mc_shader.get_program(), "position"),
+		components_per_position,
+		GL_FLOAT,
+		GL_FALSE,
+		components_per_vertex * sizeof(GLfloat),
+		0);
+
+	glUseProgram(g0_mc_shader.get_program());
+
+	C_data.clear();
+
+	for (size_t i = 0; i < C_batch.size(); i++)
+	{
+		C_data.push_back(C_batch[i].x);
+		C_data.push_back(C_batch[i].y);
+		C_data.push_back(C_batch[i].z);
+		C_data.push_back(C_batch[i].w);
+	}
+
+	glUniform4fv(glGetUniformLocation(g0_mc_shader.get_program(), "C"), num_instances, &C_data[0]);
+	glUniform1i(glGetUniformLocation(g0_mc_shader.get_program(), "max_iterations"), max_iterations);
+	glUniform1f(glGetUniformLocation(g0_mc_shader.get_program(), "threshold"), threshold);
+	glUniform1i(glGetUniformLocation(g0_mc_shader.get_program(), "field_mode"), static_cast<GLint>(mode));
+
+	// One summary record per point.
+	const size_t max_output_vertices_per_input = 1;
+
+	const size_t chunk_points = min(points_per_dispatch, static_cast<size_t>(num_vertices));
+
+	size_t max_vertices = max_output_vertices_per_input * chunk_points * num_instances;
+	size_t num_floats_per_vertex = 4;
+
+	// Allocate enough for the maximum number of vertices of one sub-dispatch, and reuse
+	// the buffer for every sub-dispatch, and for every later call that needs no more.
+	const size_t feedback_bytes = sizeof(GLfloat) * max_vertices * num_floats_per_vertex;
+
+	if (0 == feedback_buffer)
+		glGenBuffers(1, &feedback_buffer);
+
+	glBindBuffer(GL_ARRAY_BUFFER, feedback_buffer);
+
+	if (feedback_bytes > feedback_buffer_bytes)
+	{
+		glBufferData(GL_ARRAY_BUFFER, feedback_bytes, nullptr, GL_STATIC_READ);
+
+		if (GL_NO_ERROR != glGetError())
+		{
+			cerr << "Could not allocate a " << feedback_bytes / 1048576.0f
+				<< " MB transform feedback buffer; lower the device memory budget" << endl;
+
+			glDeleteBuffers(1, &feedback_buffer);
+			feedback_buffer = 0;
+			feedback_buffer_bytes = 0;
+
+			return false;
+		}
+
+		feedback_buffer_bytes = feedback_bytes;
+	}
+
+	if (0 == query)
+		glGenQueries(1, &query);
+
+	orbits.resize(num_vertices * static_cast<size_t>(num_instances));
+	fields.resize(orbits.size());
+
+	bool ok = true;
+
+	for (size_t first = 0; ok && first < num_vertices; first += chunk_points)
+	{
+		const size_t count = min(chunk_points, num_vertices - first);
+		const size_t num_records = count * num_instances;
+
+		// Perform feedback transform
+		glEnable(GL_RASTERIZER_DISCARD);
+
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, feedback_buffer);
+
+		glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, query);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArraysInstanced(GL_POINTS, static_cast<GLint>(first), static_cast<GLsizei>(count), num_instances);
+		glEndTransformFeedback();
+		glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+
+		glDisable(GL_RASTERIZER_DISCARD);
+
+		glFlush();
+
+		GLuint primitives;
+		glGetQueryObjectuiv(query, GL_QUERY_RESULT, &primitives);
+
+		// Read back actual number of vertices written by this sub-dispatch
+		feedback.resize(primitives * num_floats_per_vertex);
+
+		if (primitives > 0)
+			glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, sizeof(GLfloat) * feedback.size(), &feedback[0]);
+
+		if (GL_NO_ERROR != glGetError())
+		{
+			cerr << "Transform feedback failed for points " << first << " to " << first + count - 1 << endl;
+			ok = false;
+			break;
+		}
+
+		if (primitives != num_records * max_output_vertices_per_input)
+		{
+			cerr << "Transform feedback returned " << primitives << " vertices instead of "
+				<< num_records * max_output_vertices_per_input << endl;
+
+			ok = false;
+			break;
+		}
+
+		// Within a sub-dispatch the output is instance-major too,
+		// so record r belongs to constant r / count and point first + r % count.
+		unpack_orbit_records(workers, feedback, num_records,
+			[&](size_t r) { return (r / count) * num_vertices + first + r % count; },
+			orbits, fields);
+	}
+
+	return ok;
+}
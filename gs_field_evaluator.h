@@ -0,0 +1,61 @@
+#ifndef GS_FIELD_EVALUATOR_H
+#define GS_FIELD_EVALUATOR_H
+
+#include "field_evaluator.h"
+#include "vertex_geometry_shader.h"
+
+
+// Transform feedback bytes needed per input point: one vec4 orbit summary per Julia constant.
+size_t get_feedback_bytes_per_point(size_t num_constants);
+
+// Picks how many points go into each sub-dispatch so that neither budget is exceeded.
+// The read-back buffer and the unpacked summaries and fields each take about as much host memory
+// as the transform feedback buffer does on the device. Returns 0 if not even one point fits.
+size_t get_points_per_dispatch(const memory_budget& budget, size_t num_constants);
+
+// Writes out the source of the vertex and geometry shaders that iterate against any of num_constants
+// Julia constants. The iteration count, threshold and field mode are uniforms.
+void emit_shaders(ostream& vs_out, ostream& gs_out, size_t num_constants);
+
+// Evaluates the points in a geometry shader, one instance per Julia constant, capturing a summary of
+// each orbit by transform feedback. Needs a current GL context from init() until it is destroyed.
+class gs_field_evaluator : public field_evaluator
+{
+public:
+	gs_field_evaluator(const vector<quaternion>& src_C_batch, int src_max_iterations, float src_threshold, field_mode src_mode, const memory_budget& src_budget);
+	~gs_field_evaluator(void);
+
+	// Emits and compiles the shaders, in memory. Prints a message and returns false on failure.
+	bool init(void);
+
+	const char* get_name(void) const { return "geometry shader"; }
+	void set_field(const vector<quaternion>& src_C_batch, int src_max_iterations, float src_threshold, field_mode src_mode);
+	void set_budget(const memory_budget& src_budget) { budget = src_budget; }
+	bool evaluate(const vector<float>& points, vector<orbit_summary>& orbits, vector<float>& fields);
+
+private:
+	gs_field_evaluator(const gs_field_evaluator&);
+	gs_field_evaluator& operator=(const gs_field_evaluator&);
+
+	vertex_geometry_shader g0_mc_shader;
+
+	vector<quaternion> C_batch;
+	int max_iterations;
+	float threshold;
+	field_mode mode;
+	memory_budget budget;
+
+	// Kept from one evaluation to the next, so that evaluating another batch of the same size
+	// allocates nothing. The GL buffers only grow.
+	GLuint point_buffer;
+	size_t point_buffer_bytes;
+	GLuint feedback_buffer;
+	size_t feedback_buffer_bytes;
+	GLuint query;
+	vector<GLfloat> C_data;
+	vector<GLfloat> feedback;
+	worker_pool workers;
+};
+
+
+#endif
@@ -0,0 +1,1563 @@
+#include "julia_engine.h"
+#include "gs_field_evaluator.h"
+#include "field_cache.h"
+#include "brick_volume.h"
+#include "allocation_counter.h"
+
+#include "marching_cubes.h"
+using namespace marching_cubes;
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+using namespace std;
+
+
+// Identifies what the emitted shaders compute; part of every field cache key.
+// Bump this whenever the kernel changes, so that stale cached volumes are not reused.
+const unsigned int field_kernel_version = 2;
+
+
+// Hands each batch of triangles to the render callbacks, and then to a file writer, if there is one.
+class callback_mesh_writer : public mesh_writer
+{
+public:
+	// Takes ownership of src_writer, which may be 0.
+	callback_mesh_writer(mesh_writer* const src_writer, render_callbacks* const src_callbacks, size_t src_c, size_t src_w, size_t src_level)
+		: writer(src_writer), callbacks(src_callbacks), c(src_c), w(src_w), level(src_level)
+	{
+	}
+
+	~callback_mesh_writer(void) { delete writer; }
+
+	bool open(const char* const file_name)
+	{
+		return 0 == writer || writer->open(file_name);
+	}
+
+	bool write(const triangle_batch& batch)
+	{
+		if (0 != callbacks && false == batch.empty())
+			callbacks->on_triangles(c, w, level, batch);
+
+		return 0 == writer || writer->write(batch);
+	}
+
+	bool close(void)
+	{
+		if (0 != callbacks)
+			callbacks->on_mesh_complete(c, w, level);
+
+		return 0 == writer || writer->close();
+	}
+
+	// The callbacks are not told that the mesh is complete, since it is not.
+	void abandon(void)
+	{
+		if (0 != writer)
+			writer->abandon();
+	}
+
+private:
+	callback_mesh_writer(const callback_mesh_writer&);
+	callback_mesh_writer& operator=(const callback_mesh_writer&);
+
+	mesh_writer* writer;
+	render_callbacks* callbacks;
+	size_t c;
+	size_t w;
+	size_t level;
+};
+
+
+render_job::render_job(void)
+	: x_grid_min(-1.5f), x_grid_max(1.5f),
+	y_grid_min(-1.5f), y_grid_max(1.5f),
+	z_grid_min(-1.5f), z_grid_max(1.5f),
+	x_res(100), y_res(100), z_res(100),
+	w_min(0), w_max(0), w_res(1),
+	max_iterations(8), threshold(4.0f), mode(magnitude_field),
+	output_queue_depth(16),
+	write_mesh_files(true), output_format(stl_mesh_format),
+	use_field_cache(false), write_brick_volumes(false), incremental(true),
+	output_name("out"), lod_levels(1), deadline_seconds(0)
+{
+	C_batch.push_back(quaternion(0.3f, 0.5f, 0.4f, 0.2f));
+
+	budget.device_bytes = 256 * 1048576;
+	budget.host_bytes = 1024 * 1048576;
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		input_region_min[i] = 0;
+		input_region_max[i] = static_cast<size_t>(-1);
+	}
+}
+
+vector<float> render_job::get_isovalues(void) const
+{
+	if (false == isovalues.empty())
+		return isovalues;
+
+	return vector<float>(1, get_default_isovalue(mode, threshold, max_iterations, get_min_step_size()));
+}
+
+float render_job::get_min_step_size(void) const
+{
+	return min(min((x_grid_max - x_grid_min) / (x_res - 1), (y_grid_max - y_grid_min) / (y_res - 1)), (z_grid_max - z_grid_min) / (z_res - 1));
+}
+
+
+string get_output_file_name(const string& base_name, size_t c, size_t num_constants, size_t w, size_t w_res, size_t level, size_t num_levels, const char* const extension)
+{
+	ostringstream file_name;
+	file_name << base_name;
+
+	if (num_constants > 1)
+		file_name << "_" << c;
+
+	if (w_res > 1)
+		file_name << "_w" << w;
+
+	if (num_levels > 1)
+		file_name << "_l" << level;
+
+	file_name << extension;
+
+	return file_name.str();
+}
+
+// Hands each level's triangles over to the I/O thread, which leaves them empty.
+static void write_level_meshes(background_mesh_writer& output, size_t c, vector<triangle_batch>& level_triangles)
+{
+	for (size_t level = 0; level < level_triangles.size(); level++)
+		output.write(c * level_triangles.size() + level, level_triangles[level]);
+}
+
+// Binary STL only has face normals, so the field gradients are only worth finding
+// for the other formats, or for callbacks, which get the triangles as they are.
+static bool uses_vertex_normals(const render_job& job, const render_callbacks* callbacks)
+{
+	return 0 != callbacks || (job.write_mesh_files && stl_mesh_format != job.output_format);
+}
+
+static void close_level_meshes(background_mesh_writer& output, size_t c, size_t num_levels)
+{
+	for (size_t level = 0; level < num_levels; level++)
+		output.close(c * num_levels + level);
+}
+
+static size_t count_level_triangles(const vector<triangle_batch>& level_triangles)
+{
+	size_t count = 0;
+
+	for (size_t level = 0; level < level_triangles.size(); level++)
+		count += level_triangles[level].size();
+
+	return count;
+}
+
+static double get_level_surface_area(const vector<triangle_batch>& level_triangles)
+{
+	double area = 0;
+
+	for (size_t level = 0; level < level_triangles.size(); level++)
+	{
+		for (size_t i = 0; i < level_triangles[level].size(); i++)
+		{
+			const vertex_3* const v = level_triangles[level].triangles[i].vertex;
+
+			const float ax = v[1].x - v[0].x, ay = v[1].y - v[0].y, az = v[1].z - v[0].z;
+			const float bx = v[2].x - v[0].x, by = v[2].y - v[0].y, bz = v[2].z - v[0].z;
+
+			const float cx = ay * bz - az * by;
+			const float cy = az * bx - ax * bz;
+			const float cz = ax * by - ay * bx;
+
+			area += 0.5 * sqrt(cx * cx + cy * cy + cz * cz);
+		}
+	}
+
+	return area;
+}
+
+// Adds the orbits to the escape histogram and the orbit magnitude bounds.
+// The histogram keeps the size it was first given, so its bins never change meaning part way through a render.
+static void add_orbit_stats(const vector<orbit_summary>& orbits, int max_iterations, render_stats& stats)
+{
+	if (stats.escape_histogram.empty())
+		stats.escape_histogram.resize(max_iterations + 1, 0);
+
+	if (orbits.empty())
+		return;
+
+	const size_t last_bin = stats.escape_histogram.size() - 1;
+
+	float min_magnitude = orbits[0].min_magnitude;
+	float max_magnitude = orbits[0].max_magnitude;
+
+	for (size_t i = 0; i < orbits.size(); i++)
+	{
+		stats.escape_histogram[min(static_cast<size_t>(orbits[i].escape_iteration), last_bin)]++;
+
+		min_magnitude = min(min_magnitude, orbits[i].min_magnitude);
+		max_magnitude = max(max_magnitude, orbits[i].max_magnitude);
+	}
+
+	// The bounds start out at the first orbits seen.
+	stats.min_orbit_magnitude = stats.has_orbit_samples ? min(stats.min_orbit_magnitude, min_magnitude) : min_magnitude;
+	stats.max_orbit_magnitude = stats.has_orbit_samples ? max(stats.max_orbit_magnitude, max_magnitude) : max_magnitude;
+	stats.has_orbit_samples = true;
+}
+
+// How many triangles each batch buffer gets room for up front. A surface crosses a plane pair along
+// curves, so a batch grows with the plane's sides rather than its area; this leaves room for a crinkly one.
+// Every buffer in the output queue gets this much, so it is capped, and a batch that needs more grows.
+static size_t get_batch_reserve(size_t x_res, size_t y_res)
+{
+	const size_t max_batch_reserve = 65536;
+
+	// Tested one side at a time, so that no resolution, however big, can overflow the sum.
+	if (x_res >= max_batch_reserve / 16 || y_res >= max_batch_reserve / 16)
+		return max_batch_reserve;
+
+	return min(max_batch_reserve, 16 * (x_res + y_res));
+}
+
+// Picks how many consecutive xy planes to evaluate per slab. The slab's fields, and the orbit summaries
+// of its points, are held on the host, so the host budget bounds the depth. At least one plane is
+// always taken; a plane that does not fit whole is evaluated a chunk at a time.
+static size_t get_slab_depth(const memory_budget& budget, size_t plane_size, size_t num_constants, size_t num_planes)
+{
+	const size_t bytes_per_point = 2 * get_feedback_bytes_per_point(num_constants) + sizeof(float) * num_constants;
+	const size_t bytes_per_plane = bytes_per_point * plane_size;
+
+	size_t depth = budget.host_bytes / bytes_per_plane;
+
+	if (depth < 1)
+		depth = 1;
+
+	if (depth > num_planes)
+		depth = num_planes;
+
+	return depth;
+}
+
+// How many of a slab's slab_points points to evaluate at once, so that their orbit summaries fit in
+// the device budget, and in what the host budget has left beside the slab's fields.
+// Returns 0 if not even one point fits.
+static size_t get_points_per_chunk(const memory_budget& budget, size_t slab_points, size_t num_constants)
+{
+	const size_t field_bytes = sizeof(float) * num_constants * slab_points;
+
+	if (field_bytes >= budget.host_bytes)
+		return 0;
+
+	memory_budget chunk_budget = budget;
+	chunk_budget.host_bytes -= field_bytes;
+
+	return min(slab_points, get_points_per_dispatch(chunk_budget, num_constants));
+}
+
+// The key of the field volume for Julia constant c and w slice w is at [w * num_constants + c].
+static vector<field_volume_key> get_field_keys(const render_job& job)
+{
+	const size_t num_constants = job.C_batch.size();
+	const float w_step_size = (job.w_res > 1) ? (job.w_max - job.w_min) / (job.w_res - 1) : 0;
+
+	vector<field_volume_key> field_keys(num_constants * job.w_res);
+
+	for (size_t w = 0; w < job.w_res; w++)
+	{
+		for (size_t c = 0; c < num_constants; c++)
+		{
+			field_volume_key& key = field_keys[w * num_constants + c];
+
+			key.C = job.C_batch[c];
+			key.x_grid_min = job.x_grid_min;
+			key.x_grid_max = job.x_grid_max;
+			key.y_grid_min = job.y_grid_min;
+			key.y_grid_max = job.y_grid_max;
+			key.z_grid_min = job.z_grid_min;
+			key.z_grid_max = job.z_grid_max;
+			key.x_res = job.x_res;
+			key.y_res = job.y_res;
+			key.z_res = job.z_res;
+			key.w = job.w_min + w * w_step_size;
+			key.max_iterations = job.max_iterations;
+			key.threshold = job.threshold;
+			key.kernel_version = field_kernel_version;
+			key.field_mode = job.mode;
+		}
+	}
+
+	return field_keys;
+}
+
+// Whether the two jobs compute the same field at any given point.
+static bool is_same_field(const render_job& a, const render_job& b)
+{
+	if (a.C_batch.size() != b.C_batch.size())
+		return false;
+
+	for (size_t c = 0; c < a.C_batch.size(); c++)
+	{
+		const quaternion& C_a = a.C_batch[c];
+		const quaternion& C_b = b.C_batch[c];
+
+		if (C_a.x != C_b.x || C_a.y != C_b.y || C_a.z != C_b.z || C_a.w != C_b.w)
+			return false;
+	}
+
+	return a.max_iterations == b.max_iterations && a.threshold == b.threshold && a.mode == b.mode;
+}
+
+static double get_seconds_since(const chrono::steady_clock::time_point& start)
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+
+julia_engine::julia_engine(int src_argc, char** src_argv)
+	: argc(src_argc), argv(src_argv), tried_context(false), gs_evaluator(0), cpu_evaluator(0), evaluator(0), evaluator_num_constants(0), evaluator_setup_seconds(0)
+{
+}
+
+julia_engine::~julia_engine(void)
+{
+	// The shader program has to go before the context does.
+	release_evaluators();
+}
+
+bool julia_engine::render(const render_job& job, render_callbacks* callbacks)
+{
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	render_stats stats;
+	bool ok;
+	long long offsets[3];
+
+	if (false == job.input_brick_volume.empty())
+	{
+		// Re-mesh (a region of) an existing brick volume instead of evaluating anything.
+		stats.from_cache = true;
+		ok = mesh_brick_volume(job, callbacks, stats);
+	}
+	else if (job.deadline_seconds > 0)
+	{
+		ok = render_within_deadline(job, callbacks, stats);
+	}
+	else if (job.lod_levels > 1)
+	{
+		ok = render_lod_pyramid(job, callbacks, stats);
+	}
+	else if (job.use_field_cache && mesh_cached_field_volumes(job, callbacks, stats))
+	{
+		stats.from_cache = true;
+		ok = true;
+	}
+	else if (job.incremental && is_translation_of_previous(job, offsets))
+	{
+		ok = evaluate_exposed_and_mesh(job, callbacks, stats, offsets);
+	}
+	else
+	{
+		ok = evaluate_and_mesh(job, callbacks, stats);
+	}
+
+	stats.seconds = get_seconds_since(start);
+	stats.complete = ok;
+
+	if (ok)
+		print_render_stats(stats);
+
+	if (0 != callbacks)
+		callbacks->on_stats(stats);
+
+	return ok;
+}
+
+void print_render_stats(const render_stats& stats)
+{
+	cout << stats.num_in_set << " of " << stats.num_points << " point(s) in the set" << endl;
+	cout << "Surface area: " << stats.surface_area << " over " << stats.num_triangles << " triangle(s)" << endl;
+
+	if (false == stats.has_orbit_samples)
+		return;
+
+	cout << "Orbit magnitudes: " << stats.min_orbit_magnitude << " to " << stats.max_orbit_magnitude << endl;
+	cout << "Escape iterations:";
+
+	for (size_t i = 1; i < stats.escape_histogram.size(); i++)
+		cout << " " << i << ":" << stats.escape_histogram[i];
+
+	cout << " never:" << stats.escape_histogram[0] << endl;
+}
+
+bool julia_engine::check_evaluator_conformance(const render_job& job)
+{
+	if (false == prepare_evaluators(job))
+		return false;
+
+	// Each squaring doubles the relative error, and GPUs round trigonometry differently,
+	// so after a few iterations the backends only agree to about a percent.
+	const bool conforms = check_field_evaluator_conformance(evaluators, sample_points, 1e-2f, 0.01f);
+
+	cout << "Evaluator conformance " << (conforms ? "passed" : "FAILED") << endl;
+
+	return conforms;
+}
+
+bool julia_engine::is_same_evaluation(const render_job& job) const
+{
+	// Only the number of constants is compiled into the shaders; everything else about the field,
+	// the budget and the lattice is set on the evaluators as each job comes.
+	return 0 != evaluator && job.C_batch.size() == evaluator_num_constants;
+}
+
+void julia_engine::release_evaluators(void)
+{
+	delete gs_evaluator;
+	delete cpu_evaluator;
+
+	gs_evaluator = 0;
+	cpu_evaluator = 0;
+	evaluators.clear();
+	evaluator = 0;
+	evaluator_num_constants = 0;
+}
+
+bool julia_engine::prepare_evaluators(const render_job& job)
+{
+	const chrono::steady_clock::time_point setup_start = chrono::steady_clock::now();
+
+	// Sample whole rows from the middle of the first w slice of the job's own lattice. The sample
+	// is evaluated in one go, so it is cut down to fit in the memory budget, to part of a row if need be.
+	const size_t max_sample_points = min(static_cast<size_t>(16384), get_points_per_dispatch(job.budget, job.C_batch.size()));
+
+	if (0 == max_sample_points)
+	{
+		cout << "The memory budget is too small to evaluate even one point, with "
+			<< get_feedback_bytes_per_point(job.C_batch.size()) << " bytes per point" << endl;
+
+		return false;
+	}
+
+	const float x_step_size = (job.x_grid_max - job.x_grid_min) / (job.x_res - 1);
+	const float y_step_size = (job.y_grid_max - job.y_grid_min) / (job.y_res - 1);
+	const float z_step_size = (job.z_grid_max - job.z_grid_min) / (job.z_res - 1);
+
+	const size_t sample_rows = max(static_cast<size_t>(1), min(job.x_res, max_sample_points / job.y_res));
+	const size_t sample_columns = min(job.y_res, max_sample_points);
+
+	sample_points.clear();
+
+	for (size_t x = (job.x_res - sample_rows) / 2; x < (job.x_res - sample_rows) / 2 + sample_rows; x++)
+	{
+		for (size_t y = (job.y_res - sample_columns) / 2; y < (job.y_res - sample_columns) / 2 + sample_columns; y++)
+		{
+			sample_points.push_back(job.x_grid_min + x * x_step_size);
+			sample_points.push_back(job.y_grid_min + y * y_step_size);
+			sample_points.push_back(job.z_grid_min + (job.z_res / 2) * z_step_size);
+			sample_points.push_back(job.w_min);
+		}
+	}
+
+	if (is_same_evaluation(job))
+	{
+		for (size_t i = 0; i < evaluators.size(); i++)
+			evaluators[i]->set_field(job.C_batch, job.max_iterations, job.threshold, job.mode);
+
+		if (0 != gs_evaluator)
+			gs_evaluator->set_budget(job.budget);
+
+		return true;
+	}
+
+	release_evaluators();
+
+	// Headless where possible, so that no display or window is needed.
+	// Without a context, the CPU evaluator still works; it is just slower on a real GPU.
+	if (false == tried_context)
+	{
+		tried_context = true;
+
+		if (context.create(argc, argv))
+			cout << "OpenGL context: " << context.get_backend_name() << endl;
+	}
+
+	if (context.is_current())
+	{
+		gs_evaluator = new gs_field_evaluator(job.C_batch, job.max_iterations, job.threshold, job.mode, job.budget);
+
+		if (gs_evaluator->init())
+		{
+			evaluators.push_back(gs_evaluator);
+		}
+		else
+		{
+			delete gs_evaluator;
+			gs_evaluator = 0;
+		}
+	}
+
+	if (evaluators.empty())
+		cout << "No geometry shader evaluator; evaluating on the CPU" << endl;
+
+	cpu_evaluator = new cpu_field_evaluator(job.C_batch, job.max_iterations, job.threshold, job.mode);
+	evaluators.push_back(cpu_evaluator);
+
+	// Calibrate once, on the first job's lattice and iteration count. Later jobs with as many
+	// constants keep the choice, rather than paying for another shader build and timing run.
+	evaluator = select_fastest_field_evaluator(evaluators, sample_points);
+
+	if (0 == evaluator)
+	{
+		cout << "No field evaluator works" << endl;
+		release_evaluators();
+		return false;
+	}
+
+	cout << "Using the " << evaluator->get_name() << " evaluator" << endl;
+
+	evaluator_num_constants = job.C_batch.size();
+	evaluator_setup_seconds += get_seconds_since(setup_start);
+
+	return true;
+}
+
+// Every isovalue level of Julia constant c has its own mesh, on stream c * num_levels + level.
+// If enabled, small disconnected pieces are dropped and then the rest is simplified,
+// all on the I/O thread, before it is written and handed to the callbacks.
+void julia_engine::open_level_meshes(background_mesh_writer& output, const render_job& job, render_callbacks* callbacks, size_t c, size_t w, size_t num_levels, const vertex_3& bounds_min, const vertex_3& bounds_max)
+{
+	const size_t num_constants = job.C_batch.size();
+
+	for (size_t level = 0; level < num_levels; level++)
+	{
+		mesh_writer* writer = job.write_mesh_files ? create_mesh_writer(job.output_format, bounds_min, bounds_max) : 0;
+
+		if (0 != callbacks)
+			writer = new callback_mesh_writer(writer, callbacks, c, w, level);
+
+		if (0 == writer)
+			continue;
+
+		if (job.decimation.is_enabled())
+			writer = new decimating_mesh_writer(writer, job.decimation);
+
+		if (job.filter.is_enabled())
+			writer = new component_filter_writer(writer, job.filter);
+
+		output.open(c * num_levels + level, writer, get_output_file_name(job.output_name, c, num_constants, w, job.w_res, level, num_levels, get_mesh_format_extension(job.output_format)));
+	}
+}
+
+bool julia_engine::mesh_cached_field_volumes(const render_job& job, render_callbacks* callbacks, render_stats& stats)
+{
+	const vector<field_volume_key> field_keys = get_field_keys(job);
+
+	vector<field_volume_reader> readers(field_keys.size());
+
+	for (size_t i = 0; i < field_keys.size(); i++)
+		if (false == readers[i].open(field_keys[i]))
+			return false;
+
+	cout << "Meshing " << field_keys.size() << " cached field volume(s)" << endl;
+
+	if (remember_volumes(job))
+	{
+		const size_t plane_size = job.x_res * job.y_res;
+
+		for (size_t i = 0; i < readers.size(); i++)
+			for (size_t z = 0; z < job.z_res; z++)
+				copy(readers[i].get_plane(z), readers[i].get_plane(z) + plane_size, previous_volumes[i].begin() + z * plane_size);
+	}
+
+	return mesh_field_volumes(job, callbacks, stats, [&](size_t volume, size_t z) { return readers[volume].get_plane(z); });
+}
+
+template<typename plane_function>
+bool julia_engine::mesh_field_volumes(const render_job& job, render_callbacks* callbacks, render_stats& stats, plane_function get_plane)
+{
+	const vector<float> isovalues = job.get_isovalues();
+	const float in_set_bound = get_in_set_bound(job.mode, job.threshold, job.max_iterations);
+	const size_t num_constants = job.C_batch.size();
+	const size_t num_volumes = num_constants * job.w_res;
+
+	const size_t plane_size = job.x_res * job.y_res;
+	const vertex_3 bounds_min(job.x_grid_min, job.y_grid_min, job.z_grid_min, 0);
+	const vertex_3 bounds_max(job.x_grid_max, job.y_grid_max, job.z_grid_max, 0);
+
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	stats.num_planes += num_volumes * job.z_res;
+
+	background_mesh_writer output(job.output_queue_depth);
+	vector<triangle_batch> level_triangles(isovalues.size());
+
+	for (size_t w = 0; w < job.w_res; w++)
+	{
+		for (size_t c = 0; c < num_constants; c++)
+		{
+			open_level_meshes(output, job, callbacks, c, w, isovalues.size(), bounds_min, bounds_max);
+
+			vector<size_t> box_counts(isovalues.size(), 0);
+
+			xy_plane_window window(
+				isovalues,
+				job.x_grid_min, job.x_grid_max, job.x_res,
+				job.y_grid_min, job.y_grid_max, job.y_res,
+				job.z_grid_min, job.z_grid_max, job.z_res,
+				uses_vertex_normals(job, callbacks));
+
+			for (size_t z = 0; z < job.z_res; z++)
+			{
+				const float* plane = get_plane(w * num_constants + c, z);
+
+				if (0 == plane)
+				{
+					output.abandon();
+					return false;
+				}
+
+				for (size_t j = 0; j < plane_size; j++)
+					if (plane[j] < in_set_bound)
+						stats.num_in_set++;
+
+				if (0 != callbacks)
+					callbacks->on_field_plane(c, w, z, plane, job.x_res, job.y_res);
+
+				if (window.push(plane, z, box_counts, level_triangles) > 0)
+				{
+					stats.num_triangles += count_level_triangles(level_triangles);
+					stats.surface_area += get_level_surface_area(level_triangles);
+					write_level_meshes(output, c, level_triangles);
+				}
+
+				stats.planes_done++;
+				stats.num_points += plane_size;
+
+				if (0 != callbacks)
+				{
+					stats.seconds = get_seconds_since(start);
+					callbacks->on_stats(stats);
+				}
+			}
+
+			close_level_meshes(output, c, isovalues.size());
+		}
+	}
+
+	if (false == output.finish())
+	{
+		cout << "Error writing mesh file(s)" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool julia_engine::mesh_brick_volume(const render_job& job, render_callbacks* callbacks, render_stats& stats)
+{
+	const char* const file_name = job.input_brick_volume.c_str();
+	const vector<float> isovalues = job.get_isovalues();
+
+	brick_volume_reader reader;
+
+	if (false == reader.open(file_name))
+	{
+		cout << "Couldn't open brick volume " << file_name << endl;
+		return false;
+	}
+
+	const size_t x0 = job.input_region_min[0];
+	const size_t y0 = job.input_region_min[1];
+	const size_t z0 = job.input_region_min[2];
+	const size_t x1 = min(job.input_region_max[0], reader.get_x_res() - 1);
+	const size_t y1 = min(job.input_region_max[1], reader.get_y_res() - 1);
+	const size_t z1 = min(job.input_region_max[2], reader.get_z_res() - 1);
+
+	if (x0 >= x1 || y0 >= y1 || z0 >= z1)
+	{
+		cout << "Empty brick volume region" << endl;
+		return false;
+	}
+
+	const size_t nx = x1 - x0 + 1;
+	const size_t ny = y1 - y0 + 1;
+
+	// The region is a lattice of its own, with the same step sizes as the whole volume.
+	const float* b = reader.get_bounds();
+	const float x_step_size = (b[1] - b[0]) / (reader.get_x_res() - 1);
+	const float y_step_size = (b[3] - b[2]) / (reader.get_y_res() - 1);
+	const float z_step_size = (b[5] - b[4]) / (reader.get_z_res() - 1);
+	const float x_grid_min = b[0] + x0 * x_step_size;
+	const float y_grid_min = b[2] + y0 * y_step_size;
+	const float z_grid_min = b[4] + z0 * z_step_size;
+	const float x_grid_max = b[0] + x1 * x_step_size;
+	const float y_grid_max = b[2] + y1 * y_step_size;
+	const float z_grid_max = b[4] + z1 * z_step_size;
+
+	cout << "Meshing region [" << x0 << ", " << x1 << "] x [" << y0 << ", " << y1 << "] x [" << z0 << ", " << z1 << "] of " << file_name << endl;
+
+	// The brick volume holds one field volume, which the job describes, apart from its lattice.
+	render_job region_job = job;
+	region_job.C_batch.resize(1);
+	region_job.w_res = 1;
+	region_job.x_grid_min = x_grid_min;
+	region_job.y_grid_min = y_grid_min;
+	region_job.z_grid_min = z_grid_min;
+	region_job.x_grid_max = x_grid_max;
+	region_job.y_grid_max = y_grid_max;
+	region_job.z_grid_max = z_grid_max;
+	region_job.x_res = nx;
+	region_job.y_res = ny;
+	region_job.z_res = z1 - z0 + 1;
+
+	// Read a run of planes at a time, as they are asked for, so that each brick is decoded at most twice.
+	const size_t planes_per_read = 16;
+
+	vector<float> region;
+	size_t run_begin = 0;
+	size_t run_end = 0;
+
+	return mesh_field_volumes(region_job, callbacks, stats, [&](size_t, size_t z) -> const float*
+	{
+		if (z < run_begin || z >= run_end)
+		{
+			run_begin = z;
+			run_end = min(z + planes_per_read, region_job.z_res);
+
+			if (false == reader.read_region(x0, y0, z0 + run_begin, nx, ny, run_end - run_begin, region))
+			{
+				cout << "Corrupt brick volume " << file_name << endl;
+				return 0;
+			}
+		}
+
+		return &region[(z - run_begin) * nx * ny];
+	});
+}
+
+// Whether all of the job's field volumes fit in its host memory budget at once.
+static bool volumes_fit_host_budget(const render_job& job)
+{
+	const size_t volume_size = job.x_res * job.y_res * job.z_res;
+	const size_t num_volumes = job.C_batch.size() * job.w_res;
+
+	return num_volumes * volume_size * sizeof(float) <= job.budget.host_bytes;
+}
+
+bool julia_engine::remember_volumes(const render_job& job)
+{
+	const size_t volume_size = job.x_res * job.y_res * job.z_res;
+	const size_t num_volumes = job.C_batch.size() * job.w_res;
+
+	if (false == job.incremental || false == volumes_fit_host_budget(job))
+	{
+		previous_volumes.clear();
+		return false;
+	}
+
+	previous_job = job;
+	previous_volumes.resize(num_volumes);
+
+	for (size_t i = 0; i < num_volumes; i++)
+		previous_volumes[i].resize(volume_size);
+
+	return true;
+}
+
+bool julia_engine::is_translation_of_previous(const render_job& job, long long offsets[3]) const
+{
+	if (previous_volumes.empty()
+		|| false == volumes_fit_host_budget(job)
+		|| false == is_same_field(job, previous_job)
+		|| job.w_min != previous_job.w_min || job.w_max != previous_job.w_max || job.w_res != previous_job.w_res)
+		return false;
+
+	const float mins[3] = { job.x_grid_min, job.y_grid_min, job.z_grid_min };
+	const float maxs[3] = { job.x_grid_max, job.y_grid_max, job.z_grid_max };
+	const size_t resolutions[3] = { job.x_res, job.y_res, job.z_res };
+	const float previous_mins[3] = { previous_job.x_grid_min, previous_job.y_grid_min, previous_job.z_grid_min };
+	const float previous_maxs[3] = { previous_job.x_grid_max, previous_job.y_grid_max, previous_job.z_grid_max };
+	const size_t previous_resolutions[3] = { previous_job.x_res, previous_job.y_res, previous_job.z_res };
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		if (resolutions[i] != previous_resolutions[i])
+			return false;
+
+		const float step_size = (maxs[i] - mins[i]) / (resolutions[i] - 1);
+		const float previous_step_size = (previous_maxs[i] - previous_mins[i]) / (previous_resolutions[i] - 1);
+
+		// Bounds typed in by hand, or stepped by repeated addition, are only on the lattice to within rounding.
+		if (fabsf(step_size - previous_step_size) > 1e-5f * previous_step_size)
+			return false;
+
+		const double steps = (static_cast<double>(mins[i]) - previous_mins[i]) / previous_step_size;
+		offsets[i] = static_cast<long long>(floor(steps + 0.5));
+
+		if (fabs(steps - offsets[i]) > 1e-3 || llabs(offsets[i]) >= static_cast<long long>(resolutions[i]))
+			return false;
+	}
+
+	return true;
+}
+
+bool julia_engine::evaluate_exposed_and_mesh(const render_job& job, render_callbacks* callbacks, render_stats& stats, const long long offsets[3])
+{
+	const long long resolutions[3] = { static_cast<long long>(job.x_res), static_cast<long long>(job.y_res), static_cast<long long>(job.z_res) };
+	const size_t y_res = job.y_res;
+	const size_t plane_size = job.x_res * y_res;
+	const size_t volume_size = plane_size * job.z_res;
+	const size_t num_volumes = job.C_batch.size() * job.w_res;
+
+	// Along each axis, the lattice indices [begin, end) that the previous lattice also had. A point inside
+	// all three ranges is reused, and any other point has been newly exposed by the translation.
+	long long begin[3];
+	long long end[3];
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		begin[i] = max(0LL, -offsets[i]);
+		end[i] = min(resolutions[i], resolutions[i] - offsets[i]);
+	}
+
+	const size_t num_reused = static_cast<size_t>((end[0] - begin[0]) * (end[1] - begin[1]) * (end[2] - begin[2]));
+
+	// Move the overlap into place within the remembered volumes, a run along y at a time. Visiting the rows
+	// in the direction of the translation reads every run before anything is written over it.
+	const size_t run_length = static_cast<size_t>(end[1] - begin[1]);
+
+	for (size_t i = 0; i < num_volumes; i++)
+	{
+		float* const volume = &previous_volumes[i][0];
+
+		for (long long k = 0; k < end[2] - begin[2]; k++)
+		{
+			const long long z = (offsets[2] >= 0) ? begin[2] + k : end[2] - 1 - k;
+
+			for (long long j = 0; j < end[0] - begin[0]; j++)
+			{
+				const long long x = (offsets[0] >= 0) ? begin[0] + j : end[0] - 1 - j;
+
+				const size_t row = static_cast<size_t>(z) * plane_size + static_cast<size_t>(x) * y_res + static_cast<size_t>(begin[1]);
+				const size_t previous_row = static_cast<size_t>(z + offsets[2]) * plane_size + static_cast<size_t>(x + offsets[0]) * y_res + static_cast<size_t>(begin[1] + offsets[1]);
+
+				memmove(volume + row, volume + previous_row, run_length * sizeof(float));
+			}
+		}
+	}
+
+	stats.num_reused += num_reused * num_volumes;
+
+	cout << "Panned by (" << offsets[0] << ", " << offsets[1] << ", " << offsets[2] << ") lattice steps; reusing "
+		<< num_reused << " of " << volume_size << " point(s) per volume, evaluating " << volume_size - num_reused << endl;
+
+	return evaluate_new_points_and_mesh(job, callbacks, stats, [&](size_t x, size_t y, size_t z)
+	{
+		const long long p[3] = { static_cast<long long>(x), static_cast<long long>(y), static_cast<long long>(z) };
+
+		return p[0] < begin[0] || p[0] >= end[0] || p[1] < begin[1] || p[1] >= end[1] || p[2] < begin[2] || p[2] >= end[2];
+	});
+}
+
+bool julia_engine::is_coarser_level_of_previous(const render_job& job) const
+{
+	return false == previous_volumes.empty()
+		&& volumes_fit_host_budget(job)
+		&& is_same_field(job, previous_job)
+		&& job.w_min == previous_job.w_min && job.w_max == previous_job.w_max && job.w_res == previous_job.w_res
+		&& job.x_grid_min == previous_job.x_grid_min && job.x_grid_max == previous_job.x_grid_max && job.x_res - 1 == 2 * (previous_job.x_res - 1)
+		&& job.y_grid_min == previous_job.y_grid_min && job.y_grid_max == previous_job.y_grid_max && job.y_res - 1 == 2 * (previous_job.y_res - 1)
+		&& job.z_grid_min == previous_job.z_grid_min && job.z_grid_max == previous_job.z_grid_max && job.z_res - 1 == 2 * (previous_job.z_res - 1);
+}
+
+bool julia_engine::evaluate_refined_and_mesh(const render_job& job, render_callbacks* callbacks, render_stats& stats)
+{
+	const size_t num_volumes = job.C_batch.size() * job.w_res;
+	const size_t y_res = job.y_res;
+	const size_t plane_size = job.x_res * y_res;
+	const size_t volume_size = plane_size * job.z_res;
+	const size_t coarse_x_res = previous_job.x_res;
+	const size_t coarse_y_res = previous_job.y_res;
+	const size_t coarse_z_res = previous_job.z_res;
+	const size_t coarse_plane_size = coarse_x_res * coarse_y_res;
+	const size_t coarse_volume_size = coarse_plane_size * coarse_z_res;
+
+	// Every lattice point with all even indices is a point of the coarser lattice. Each remembered volume
+	// is grown to the finer lattice and its points are spread out to their new places, last first, since
+	// no point moves to an index lower than its own.
+	for (size_t i = 0; i < num_volumes; i++)
+	{
+		vector<float>& volume = previous_volumes[i];
+		volume.resize(volume_size);
+
+		for (size_t z = coarse_z_res; z-- > 0;)
+			for (size_t x = coarse_x_res; x-- > 0;)
+				for (size_t y = coarse_y_res; y-- > 0;)
+					volume[(2 * z) * plane_size + (2 * x) * y_res + 2 * y] = volume[z * coarse_plane_size + x * coarse_y_res + y];
+	}
+
+	stats.num_reused += coarse_volume_size * num_volumes;
+
+	cout << "Refining; reusing " << coarse_volume_size << " of " << volume_size << " point(s) per volume, evaluating " << volume_size - coarse_volume_size << endl;
+
+	// The rest have an odd index along some axis.
+	return evaluate_new_points_and_mesh(job, callbacks, stats, [](size_t x, size_t y, size_t z) { return 0 != ((x | y | z) & 1); });
+}
+
+bool julia_engine::render_lod_pyramid(const render_job& job, render_callbacks* callbacks, render_stats& stats)
+{
+	const size_t num_lods = job.lod_levels;
+
+	// How many steps of the finest lattice make one step of the coarsest.
+	const size_t scale = static_cast<size_t>(1) << (num_lods - 1);
+
+	if (0 != (job.x_res - 1) % scale || 0 != (job.y_res - 1) % scale || 0 != (job.z_res - 1) % scale)
+	{
+		cout << "For " << num_lods << " levels of detail, every resolution must be one more than a multiple of " << scale
+			<< "; resolutions of 2^k + 1 allow the most levels" << endl;
+
+		return false;
+	}
+
+	// Choose the evaluator on the finest lattice, where nearly all of the time goes, rather than on the
+	// coarsest. Every level then keeps the same pair, since the levels only differ in resolution.
+	if (false == prepare_evaluators(job))
+		return false;
+
+	for (size_t lod = 0; lod < num_lods; lod++)
+	{
+		const size_t step = scale >> lod;
+
+		if (false == render_level(job, lod, num_lods, (job.x_res - 1) / step + 1, (job.y_res - 1) / step + 1, (job.z_res - 1) / step + 1, callbacks, stats))
+			return false;
+	}
+
+	return true;
+}
+
+bool julia_engine::render_level(const render_job& job, size_t lod, size_t num_lods, size_t x_res, size_t y_res, size_t z_res, render_callbacks* callbacks, render_stats& stats)
+{
+	// Each level keeps its volumes, so that the next one only evaluates the points it adds.
+	render_job level_job = job;
+	level_job.x_res = x_res;
+	level_job.y_res = y_res;
+	level_job.z_res = z_res;
+	level_job.lod_levels = 1;
+	level_job.deadline_seconds = 0;
+	level_job.incremental = true;
+
+	ostringstream output_name;
+	output_name << job.output_name << "_lod" << lod;
+	level_job.output_name = output_name.str();
+
+	cout << "Level of detail " << lod;
+
+	if (num_lods > 0)
+		cout << " of " << num_lods - 1;
+
+	cout << ": " << x_res << " x " << y_res << " x " << z_res << " lattice" << endl;
+
+	if (0 != callbacks)
+		callbacks->on_lod_level(lod, num_lods, x_res, y_res, z_res);
+
+	if (job.use_field_cache && mesh_cached_field_volumes(level_job, callbacks, stats))
+		return true;
+
+	if (is_coarser_level_of_previous(level_job))
+		return evaluate_refined_and_mesh(level_job, callbacks, stats);
+
+	return evaluate_and_mesh(level_job, callbacks, stats);
+}
+
+// The number of lattice points in all of the job's field volumes, given the steps along each axis.
+static double get_lattice_points(const render_job& job, const size_t steps[3])
+{
+	return static_cast<double>(job.C_batch.size() * job.w_res) * (steps[0] + 1) * (steps[1] + 1) * (steps[2] + 1);
+}
+
+bool julia_engine::render_within_deadline(const render_job& job, render_callbacks* callbacks, render_stats& stats)
+{
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	const double deadline = job.deadline_seconds;
+
+	// The job's own lattice is the finest that is ever rendered.
+	const size_t job_steps[3] = { job.x_res - 1, job.y_res - 1, job.z_res - 1 };
+	const size_t max_steps = max(max(job_steps[0], job_steps[1]), job_steps[2]);
+
+	// Every level has the job's proportions, as near as whole steps allow, starting from at most
+	// this many steps along the longest axis.
+	const size_t first_level_steps = 16;
+
+	size_t steps[3];
+
+	for (size_t i = 0; i < 3; i++)
+		steps[i] = max(static_cast<size_t>(1), job_steps[i] * min(first_level_steps, max_steps) / max_steps);
+
+	// Time the evaluator on a slab of the job's own lattice, at the job's iteration count.
+	if (false == prepare_evaluators(job))
+		return false;
+
+	const chrono::steady_clock::time_point calibration_start = chrono::steady_clock::now();
+
+	if (false == evaluator->evaluate(sample_points, slab.orbits, slab.fields))
+	{
+		cout << "Deadline calibration failed" << endl;
+		return false;
+	}
+
+	const double seconds_per_iteration = get_seconds_since(calibration_start) / (sample_points.size() / 4 * job.C_batch.size() * job.max_iterations);
+
+	// Leave most of the time for refining; if even the first level would not fit in what is left, lower
+	// the iteration count until it does. It is rendered regardless, so that there is always a mesh.
+	const double first_level_seconds = (deadline - get_seconds_since(start)) / 4;
+
+	render_job deadline_job = job;
+
+	if (get_lattice_points(job, steps) * seconds_per_iteration * job.max_iterations > first_level_seconds)
+	{
+		deadline_job.max_iterations = max(1, static_cast<int>(first_level_seconds / (get_lattice_points(job, steps) * seconds_per_iteration)));
+
+		cout << "Lowering the iteration count from " << job.max_iterations << " to " << deadline_job.max_iterations << " to meet the deadline" << endl;
+	}
+
+	// Every level has one bin per iteration of the job's own count, whatever count the levels run with.
+	stats.escape_histogram.assign(job.max_iterations + 1, 0);
+
+	// How long a level took, leaving out any evaluator setup within it, which is only ever paid once
+	// and so says nothing about what the next level will cost.
+	double level_start = 0;
+	double level_setup_start = 0;
+
+	auto get_level_seconds = [&]()
+	{
+		return get_seconds_since(start) - level_start - (evaluator_setup_seconds - level_setup_start);
+	};
+
+	size_t lod = 0;
+	level_start = get_seconds_since(start);
+	level_setup_start = evaluator_setup_seconds;
+
+	if (false == render_level(deadline_job, lod, 0, steps[0] + 1, steps[1] + 1, steps[2] + 1, callbacks, stats))
+		return false;
+
+	// What each lattice point of a level costs, from evaluation to written mesh. Refining only evaluates
+	// seven in eight points, so it gets its own, cheaper, measure once it has been seen. A level that came
+	// from the field cache says little about the next, so neither is ever taken below the calibrated cost.
+	const double seconds_per_evaluated_point = seconds_per_iteration * deadline_job.max_iterations;
+	const double seconds_per_point = max(seconds_per_evaluated_point, get_level_seconds() / get_lattice_points(job, steps));
+	double seconds_per_refined_point = seconds_per_point;
+
+	// Halve the steps while the result fits in the job's lattice and is predicted to finish in time.
+	// Levels are never cut short, so a prediction that is too low overruns the deadline.
+	for (;;)
+	{
+		const size_t next_steps[3] = { 2 * steps[0], 2 * steps[1], 2 * steps[2] };
+
+		if (next_steps[0] > job_steps[0] || next_steps[1] > job_steps[1] || next_steps[2] > job_steps[2])
+			break;
+
+		if (get_seconds_since(start) + seconds_per_refined_point * get_lattice_points(job, next_steps) > deadline)
+			break;
+
+		lod++;
+		level_start = get_seconds_since(start);
+		level_setup_start = evaluator_setup_seconds;
+
+		if (false == render_level(deadline_job, lod, 0, next_steps[0] + 1, next_steps[1] + 1, next_steps[2] + 1, callbacks, stats))
+			return false;
+
+		seconds_per_refined_point = max(seconds_per_evaluated_point * 7 / 8, get_level_seconds() / get_lattice_points(job, next_steps));
+
+		for (size_t i = 0; i < 3; i++)
+			steps[i] = next_steps[i];
+	}
+
+	// Then spend what is left on the finest lattice between the last level and the job's own that can
+	// still be evaluated from scratch in time.
+	const size_t level_steps = max(max(steps[0], steps[1]), steps[2]);
+
+	for (size_t n = max_steps; n > level_steps; n--)
+	{
+		size_t final_steps[3];
+
+		for (size_t i = 0; i < 3; i++)
+			final_steps[i] = max(static_cast<size_t>(1), job_steps[i] * n / max_steps);
+
+		if (get_seconds_since(start) + seconds_per_point * get_lattice_points(job, final_steps) > deadline)
+			continue;
+
+		lod++;
+
+		if (false == render_level(deadline_job, lod, 0, final_steps[0] + 1, final_steps[1] + 1, final_steps[2] + 1, callbacks, stats))
+			return false;
+
+		break;
+	}
+
+	const double seconds = get_seconds_since(start);
+
+	cout << "Finished level of detail " << lod << " in " << seconds << " of " << deadline << " second(s)";
+
+	if (seconds > deadline)
+		cout << ", over the deadline by " << seconds - deadline;
+
+	cout << endl;
+
+	return true;
+}
+
+template<typename point_predicate>
+bool julia_engine::evaluate_new_points_and_mesh(const render_job& job, render_callbacks* callbacks, render_stats& stats, point_predicate is_new)
+{
+	const size_t num_constants = job.C_batch.size();
+	const size_t x_res = job.x_res;
+	const size_t y_res = job.y_res;
+	const size_t z_res = job.z_res;
+	const size_t plane_size = x_res * y_res;
+
+	// The volumes are part way between two jobs from here on, so they are only kept if this one succeeds.
+	previous_job = job;
+
+	if (false == prepare_evaluators(job))
+	{
+		previous_volumes.clear();
+		return false;
+	}
+
+	const float x_step_size = (job.x_grid_max - job.x_grid_min) / (x_res - 1);
+	const float y_step_size = (job.y_grid_max - job.y_grid_min) / (y_res - 1);
+	const float z_step_size = (job.z_grid_max - job.z_grid_min) / (z_res - 1);
+	const float w_step_size = (job.w_res > 1) ? (job.w_max - job.w_min) / (job.w_res - 1) : 0;
+
+	// As many points per evaluation as fit in the memory budget.
+	const size_t points_per_batch = get_points_per_dispatch(job.budget, num_constants);
+
+	if (0 == points_per_batch)
+	{
+		cout << "The memory budget is too small to evaluate even one point, with "
+			<< get_feedback_bytes_per_point(num_constants) << " bytes per point" << endl;
+
+		previous_volumes.clear();
+		return false;
+	}
+
+	vector<float>& points = slab.points;
+	vector<size_t>& indices = slab.indices;
+	vector<orbit_summary>& orbits = slab.orbits;
+	vector<float>& fields = slab.fields;
+
+	points.reserve(4 * points_per_batch);
+	indices.reserve(points_per_batch);
+
+	for (size_t w = 0; w < job.w_res; w++)
+	{
+		const float w_value = job.w_min + w * w_step_size;
+
+		// Evaluates the points gathered so far, and puts their fields in place.
+		auto evaluate_batch = [&](void)
+		{
+			if (indices.empty())
+				return true;
+
+			if (false == evaluator->evaluate(points, orbits, fields))
+				return false;
+
+			// Instance-major, one run of indices.size() points per constant.
+			for (size_t c = 0; c < num_constants; c++)
+			{
+				vector<float>& volume = previous_volumes[w * num_constants + c];
+
+				for (size_t i = 0; i < indices.size(); i++)
+					volume[indices[i]] = fields[c * indices.size() + i];
+			}
+
+			add_orbit_stats(orbits, job.max_iterations, stats);
+
+			points.clear();
+			indices.clear();
+
+			return true;
+		};
+
+		points.clear();
+		indices.clear();
+
+		// Walk the lattice plane by plane, gathering the new points into batches.
+		for (size_t z = 0; z < z_res; z++)
+		{
+			for (size_t x = 0; x < x_res; x++)
+			{
+				for (size_t y = 0; y < y_res; y++)
+				{
+					if (false == is_new(x, y, z))
+						continue;
+
+					indices.push_back(z * plane_size + x * y_res + y);
+					points.push_back(job.x_grid_min + x * x_step_size);
+					points.push_back(job.y_grid_min + y * y_step_size);
+					points.push_back(job.z_grid_min + z * z_step_size);
+					points.push_back(w_value);
+
+					if (indices.size() == points_per_batch && false == evaluate_batch())
+					{
+						cout << "Evaluation failed; no mesh written" << endl;
+						previous_volumes.clear();
+						return false;
+					}
+				}
+			}
+		}
+
+		if (false == evaluate_batch())
+		{
+			cout << "Evaluation failed; no mesh written" << endl;
+			previous_volumes.clear();
+			return false;
+		}
+	}
+
+	const vector<vector<float>>& volumes = previous_volumes;
+
+	if (job.use_field_cache || job.write_brick_volumes)
+	{
+		const vector<field_volume_key> field_keys = get_field_keys(job);
+		const float grid_bounds[6] = { job.x_grid_min, job.x_grid_max, job.y_grid_min, job.y_grid_max, job.z_grid_min, job.z_grid_max };
+
+		for (size_t w = 0; w < job.w_res; w++)
+		{
+			for (size_t c = 0; c < num_constants; c++)
+			{
+				const vector<float>& volume = volumes[w * num_constants + c];
+
+				field_volume_writer field_writer;
+				brick_volume_writer brick_writer;
+
+				if (job.use_field_cache && false == field_writer.open(field_keys[w * num_constants + c]))
+					cout << "Couldn't write field cache volume " << field_keys[w * num_constants + c].get_file_name() << endl;
+
+				if (job.write_brick_volumes && false == brick_writer.open(get_output_file_name(job.output_name, c, num_constants, w, job.w_res, 0, 1, ".jbv").c_str(), x_res, y_res, z_res, grid_bounds))
+					cout << "Couldn't write brick volume" << endl;
+
+				for (size_t z = 0; z < z_res; z++)
+				{
+					if (field_writer.is_open())
+						field_writer.append_plane(&volume[z * plane_size]);
+
+					if (brick_writer.is_open())
+						brick_writer.append_plane(&volume[z * plane_size]);
+				}
+
+				if (field_writer.is_open())
+					field_writer.close();
+
+				if (brick_writer.is_open())
+					brick_writer.close();
+			}
+		}
+	}
+
+	return mesh_field_volumes(job, callbacks, stats, [&](size_t volume, size_t z) { return &volumes[volume][z * plane_size]; });
+}
+
+bool julia_engine::evaluate_and_mesh(const render_job& job, render_callbacks* callbacks, render_stats& stats)
+{
+	if (false == prepare_evaluators(job))
+		return false;
+
+	const vector<field_volume_key> field_keys = job.use_field_cache ? get_field_keys(job) : vector<field_volume_key>();
+	const vector<float> isovalues = job.get_isovalues();
+	const size_t num_levels = isovalues.size();
+	const size_t num_constants = job.C_batch.size();
+	const float in_set_bound = get_in_set_bound(job.mode, job.threshold, job.max_iterations);
+
+	const size_t x_res = job.x_res;
+	const size_t y_res = job.y_res;
+	const size_t z_res = job.z_res;
+	const size_t w_res = job.w_res;
+
+	vector<float>& point_vertex_data = slab.points;
+
+	const float x_step_size = (job.x_grid_max - job.x_grid_min) / (x_res - 1);
+	const float y_step_size = (job.y_grid_max - job.y_grid_min) / (y_res - 1);
+	const float z_step_size = (job.z_grid_max - job.z_grid_min) / (z_res - 1);
+	const float w_step_size = (w_res > 1) ? (job.w_max - job.w_min) / (w_res - 1) : 0;
+
+	const size_t plane_size = x_res * y_res;
+
+	// The xy planes of all of the w slices form one stream of w_res * z_res planes, so that
+	// a slab can run on past the end of one w slice and into the next.
+	const size_t num_planes = w_res * z_res;
+
+	// Evaluate several consecutive xy planes per slab, as many as fit in the memory budget,
+	// and split the slab into chunks that each fit, down to part of a plane if need be.
+	const size_t slab_depth = get_slab_depth(job.budget, plane_size, num_constants, num_planes);
+	const size_t points_per_slab = slab_depth * plane_size;
+	const size_t points_per_chunk = get_points_per_chunk(job.budget, points_per_slab, num_constants);
+
+	if (0 == points_per_chunk)
+	{
+		cout << "The memory budget is too small to evaluate even one point beside an xy plane's fields, which take "
+			<< sizeof(float) * num_constants * plane_size / 1048576.0f << " MB of the " << job.budget.host_bytes / 1048576.0f
+			<< " MB host budget, with " << get_feedback_bytes_per_point(num_constants) << " bytes per point" << endl;
+
+		return false;
+	}
+
+	cout << "Evaluating " << slab_depth << " xy-plane(s) per slab, in "
+		<< (points_per_slab + points_per_chunk - 1) / points_per_chunk
+		<< " chunk(s) of up to " << points_per_chunk << " points" << endl;
+
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	stats.num_planes += num_planes * num_constants;
+
+	// Everything the loop over the slabs needs is sized here, so that once the first xy plane of a
+	// w slice has opened its meshes and files, the rest of the slice allocates nothing.
+	point_vertex_data.reserve(4 * points_per_chunk);
+
+	vector<float>& slab_fields = slab.slab_fields;
+	slab_fields.resize(num_constants * points_per_slab);
+
+	vector<float>& xyplane = slab.xyplane;
+	xyplane.resize(plane_size);
+
+	// Only the batches of meshes that use vertex normals carry them.
+	const bool vertex_normals = uses_vertex_normals(job, callbacks);
+
+	// One window of xy planes per Julia constant, and one triangle batch and box count per constant per level.
+	vector<xy_plane_window> windows(num_constants, xy_plane_window(
+		isovalues,
+		job.x_grid_min, job.x_grid_max, x_res,
+		job.y_grid_min, job.y_grid_max, y_res,
+		job.z_grid_min, job.z_grid_max, z_res,
+		vertex_normals));
+	vector<vector<triangle_batch>> triangles(num_constants, vector<triangle_batch>(num_levels));
+	vector<vector<size_t>> box_counts(num_constants, vector<size_t>(num_levels, 0));
+
+	const size_t batch_reserve = get_batch_reserve(x_res, y_res);
+
+	for (size_t c = 0; c < num_constants; c++)
+		for (size_t level = 0; level < num_levels; level++)
+			triangles[c][level].reserve(batch_reserve, vertex_normals);
+
+	// Finished triangles are encoded and written on a separate thread while evaluation continues.
+	// At most output_queue_depth batches of triangles wait to be written at any one time.
+	background_mesh_writer output(job.output_queue_depth, batch_reserve, vertex_normals);
+
+	// The compact format quantizes positions relative to the grid bounds.
+	const vertex_3 bounds_min(job.x_grid_min, job.y_grid_min, job.z_grid_min, 0);
+	const vertex_3 bounds_max(job.x_grid_max, job.y_grid_max, job.z_grid_max, 0);
+
+	// One cache volume and one brick volume are being written per Julia constant at any one time.
+	vector<field_volume_writer> field_writers(job.use_field_cache ? num_constants : 0);
+	vector<brick_volume_writer> brick_writers(job.write_brick_volumes ? num_constants : 0);
+	const float grid_bounds[6] = { job.x_grid_min, job.x_grid_max, job.y_grid_min, job.y_grid_max, job.z_grid_min, job.z_grid_max };
+
+	vector<orbit_summary>& local_orbits = slab.orbits;
+	vector<float>& local_fields = slab.fields;
+
+	// Allocations made after the first plane of each w slice, which opens that slice's meshes and files.
+	size_t slice_start_allocations = 0;
+	size_t steady_allocations = 0;
+
+	// Keep the volumes, if they fit, in case the next job is a pan of this one.
+	const bool remember = remember_volumes(job);
+
+	// The lattice is walked as one stream of points, which the chunks cut wherever they end.
+	// (x, y) is the next point to evaluate in plane p of the stream.
+	quaternion Z(job.x_grid_min, job.y_grid_min, job.z_grid_min, job.w_min);
+	size_t x = 0, y = 0, p = 0;
+
+	for (size_t slab_begin = 0; slab_begin < num_planes; slab_begin += slab_depth)
+	{
+		const size_t planes_in_slab = min(slab_depth, num_planes - slab_begin);
+		const size_t points_in_slab = planes_in_slab * plane_size;
+
+		for (size_t first = 0; first < points_in_slab; first += points_per_chunk)
+		{
+			const size_t count = min(points_per_chunk, points_in_slab - first);
+
+			point_vertex_data.clear();
+
+			for (size_t i = 0; i < count; i++)
+			{
+				if (0 == x && 0 == y)
+				{
+					// Move on to the next w slice.
+					if (0 == p % z_res && 0 != p)
+					{
+						Z.z = job.z_grid_min;
+						Z.w += w_step_size;
+					}
+
+					Z.x = job.x_grid_min;
+				}
+
+				if (0 == y)
+					Z.y = job.y_grid_min;
+
+				point_vertex_data.push_back(Z.x);
+				point_vertex_data.push_back(Z.y);
+				point_vertex_data.push_back(Z.z);
+				point_vertex_data.push_back(Z.w);
+
+				Z.y += y_step_size;
+
+				if (++y == y_res)
+				{
+					y = 0;
+					Z.x += x_step_size;
+
+					if (++x == x_res)
+					{
+						x = 0;
+						p++;
+						Z.z += z_step_size;
+					}
+				}
+			}
+
+			if (false == evaluator->evaluate(point_vertex_data, local_orbits, local_fields))
+			{
+				cout << "Evaluation failed; abandoning the meshes and volumes being written" << endl;
+				previous_volumes.clear();
+				output.abandon();
+
+				for (size_t c = 0; c < brick_writers.size(); c++)
+					brick_writers[c].abandon();
+
+				return false;
+			}
+
+			// The fields come back instance-major, one run of count per constant, and are put in their place in the slab.
+			// Only the chunk's orbit summaries are held, so their statistics are gathered now.
+			for (size_t c = 0; c < num_constants; c++)
+				copy(local_fields.begin() + c * count, local_fields.begin() + (c + 1) * count, slab_fields.begin() + c * points_in_slab + first);
+
+			add_orbit_stats(local_orbits, job.max_iterations, stats);
+		}
+
+		// Hand the slab's planes to marching cubes one by one.
+		for (size_t k = 0; k < planes_in_slab; k++)
+		{
+			const size_t w = (slab_begin + k) / z_res;
+			const size_t z = (slab_begin + k) % z_res;
+
+			for (size_t c = 0; c < num_constants; c++)
+			{
+				// The slab's fields are instance-major, one slab per constant.
+				const size_t offset = c * points_in_slab + k * plane_size;
+
+				for (size_t j = 0; j < plane_size; j++)
+				{
+					xyplane[j] = slab_fields[offset + j];
+
+					if (xyplane[j] < in_set_bound)
+						stats.num_in_set++;
+				}
+
+				if (0 != callbacks)
+					callbacks->on_field_plane(c, w, z, &xyplane[0], x_res, y_res);
+
+				if (remember)
+					copy(xyplane.begin(), xyplane.end(), previous_volumes[w * num_constants + c].begin() + z * plane_size);
+
+				// A new w slice is starting, so start its mesh file.
+				if (0 == z)
+				{
+					open_level_meshes(output, job, callbacks, c, w, num_levels, bounds_min, bounds_max);
+
+					if (job.use_field_cache && false == field_writers[c].open(field_keys[w * num_constants + c]))
+						cout << "Couldn't write field cache volume " << field_keys[w * num_constants + c].get_file_name() << endl;
+
+					if (job.write_brick_volumes && false == brick_writers[c].open(get_output_file_name(job.output_name, c, num_constants, w, w_res, 0, 1, ".jbv").c_str(), x_res, y_res, z_res, grid_bounds))
+						cout << "Couldn't write brick volume" << endl;
+				}
+
+				if (job.use_field_cache && field_writers[c].is_open())
+					field_writers[c].append_plane(&xyplane[0]);
+
+				if (job.write_brick_volumes && brick_writers[c].is_open())
+					brick_writers[c].append_plane(&xyplane[0]);
+
+				if (z > 0 && 0 == c)
+				{
+					if (w_res > 1)
+						cout << "w slice " << w << " of " << w_res - 1 << ": ";
+
+					cout << "Calculating triangles from xy-plane pair " << z << " of " << z_res - 1 << endl;
+				}
+
+				// Calculate triangles by marching cubes for whichever xy-plane pairs now have
+				// the planes either side of them, which their gradient normals need.
+				windows[c].push(&xyplane[0], z, box_counts[c], triangles[c]);
+
+				stats.num_triangles += count_level_triangles(triangles[c]);
+				stats.surface_area += get_level_surface_area(triangles[c]);
+
+				// Hand the pair's triangles over to the I/O thread, which leaves triangles[c] empty.
+				write_level_meshes(output, c, triangles[c]);
+
+				// The w slice is complete, so finish its mesh file and start afresh.
+				if (z == z_res - 1)
+				{
+					close_level_meshes(output, c, num_levels);
+
+					if (job.use_field_cache && field_writers[c].is_open())
+						field_writers[c].close();
+
+					if (job.write_brick_volumes && brick_writers[c].is_open())
+						brick_writers[c].close();
+
+					box_counts[c].assign(num_levels, 0);
+				}
+
+				stats.planes_done++;
+				stats.num_points += plane_size;
+
+				if (0 != callbacks)
+				{
+					stats.seconds = get_seconds_since(start);
+					callbacks->on_stats(stats);
+				}
+			}
+
+			// Every constant's first plane of the slice has opened its meshes and files, so the rest of
+			// the slice is in its steady state.
+			if (0 == z)
+				slice_start_allocations = get_thread_heap_allocations();
+
+			if (z == z_res - 1)
+				steady_allocations += get_thread_heap_allocations() - slice_start_allocations;
+		}
+	}
+
+	bool ok = true;
+
+	if (false == output.finish())
+	{
+		cout << "Error writing mesh file(s)" << endl;
+		ok = false;
+	}
+
+	// When counting, an allocation in the steady state fails the render, so that the check can gate a build.
+	// The meshes have been written in full by then, and are kept.
+	if (is_counting_heap_allocations())
+	{
+		cout << "Heap allocations on the rendering thread after the first xy plane of each w slice: " << steady_allocations
+			<< (0 == steady_allocations ? " (pass)" : " (FAIL)") << endl;
+
+		if (0 != steady_allocations)
+			ok = false;
+	}
+
+	return ok;
+}
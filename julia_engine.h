@@ -0,0 +1,291 @@
+#ifndef JULIA_ENGINE_H
+#define JULIA_ENGINE_H
+
+#include "primitives.h"
+#include "field_evaluator.h"
+#include "gl_context.h"
+#include "mesh_writer.h"
+#include "mesh_filter.h"
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+
+class gs_field_evaluator;
+class cpu_field_evaluator;
+class background_mesh_writer;
+
+
+// Names the output file for Julia constant c, w slice w and isovalue level.
+// A single constant, w slice and level give the classic out.stl (or out.ply, out.jcm, out.jbv).
+string get_output_file_name(const string& base_name, size_t c, size_t num_constants, size_t w, size_t w_res, size_t level, size_t num_levels, const char* const extension);
+
+
+// Everything that describes one render: the lattice, the Julia constants, the field,
+// and what to do with the results. The defaults are the classic single out.stl run.
+class render_job
+{
+public:
+	render_job(void);
+
+	// The isovalues, or the mode's default isovalue if none are given.
+	vector<float> get_isovalues(void) const;
+
+	float get_min_step_size(void) const;
+
+	float x_grid_min, x_grid_max;
+	float y_grid_min, y_grid_max;
+	float z_grid_min, z_grid_max;
+	size_t x_res, y_res, z_res;
+
+	// The 4D hyper-volume is sampled as w_res 3D cross-sections, evenly spaced over [w_min, w_max].
+	// Every cross-section gets its own mesh. With w_res = 1 only the w = w_min section is made.
+	float w_min, w_max;
+	size_t w_res;
+
+	// Every constant in this batch is evaluated against the same lattice in one instanced draw,
+	// and each produces its own mesh.
+	vector<quaternion> C_batch;
+
+	int max_iterations;
+	float threshold;
+	field_mode mode;
+
+	// A surface is extracted wherever the field crosses one of these values, all in the same
+	// sweep over each plane pair, with one mesh per value (out_l<i> when there is more than one).
+	// They are not part of the field cache key, so changing them only costs a re-mesh of the cached volumes.
+	vector<float> isovalues;
+
+	// Upper bounds on the memory used by the evaluator, in bytes.
+	memory_budget budget;
+
+	// Number of slice-pair triangle batches that may wait for the I/O thread.
+	size_t output_queue_depth;
+
+	// Write out[_c][_w<w>][_l<level>] mesh files. Callbacks get the triangles either way.
+	bool write_mesh_files;
+	mesh_format output_format;
+
+	// Applied on the output thread, before the triangles reach the files or the callbacks.
+	component_filter_settings filter;
+	decimation_settings decimation;
+
+	// Keep every evaluated field volume on disk, keyed by the parameters that produced it.
+	// When every volume a job needs is already cached, the job goes straight to meshing.
+	// Off by default: the field_*.vol files go in the working directory, take 4 bytes per
+	// lattice point, and are never evicted.
+	bool use_field_cache;
+
+	// Also write every field volume out as a compressed brick volume (out[_c][_w<w>].jbv).
+	bool write_brick_volumes;
+
+	// Remember the field volumes, if they fit in the host budget, so that a following job on the same
+	// lattice, only translated by whole lattice steps, reuses the overlap and only evaluates what is newly
+	// exposed. The reused samples were taken at the old bounds, so they can differ from a fresh evaluation
+	// by the rounding in the lattice positions.
+	bool incremental;
+
+	// Output files are named <output_name>[_c][_w<w>][_l<level>].
+	string output_name;
+
+	// With more than one level, a pyramid of coarser lattices is rendered first, each with half the steps
+	// of the next, into <output_name>_lod<k> files from the coarsest (k = 0) up to the job's own lattice.
+	// Each level reuses every sample of the one before, so the finest level costs little more than
+	// a direct render. Each resolution minus one must be divisible by 2^(lod_levels - 1).
+	size_t lod_levels;
+
+	// If positive, render levels of detail into <output_name>_lod<k> files instead, coarsest first, for as
+	// long as the next level is predicted to finish within this many seconds. The prediction comes from
+	// timing the evaluator on a slab of the job's lattice, and then from the levels already rendered.
+	// The job's lattice and iteration count are upper bounds; the iteration count is lowered only if even
+	// the first level would not fit. The first level is always rendered, so there is always a mesh, and
+	// a level that has started is always finished. lod_levels is ignored.
+	// The deadline is a soft target: the time left is only checked between levels, so a level that takes
+	// longer than predicted runs on past it, by up to the whole time of the finest level rendered.
+	double deadline_seconds;
+
+	// If set, just mesh this brick volume, limited to the given box of lattice indices.
+	string input_brick_volume;
+	size_t input_region_min[3];
+	size_t input_region_max[3];
+};
+
+// Running totals for a render, over all Julia constants, w slices and levels of detail, gathered
+// plane by plane as the render goes.
+class render_stats
+{
+public:
+	render_stats(void) : num_planes(0), planes_done(0), num_points(0), num_reused(0), num_in_set(0), num_triangles(0), surface_area(0), min_orbit_magnitude(0), max_orbit_magnitude(0), has_orbit_samples(false), seconds(0), from_cache(false), complete(false) { }
+
+	size_t num_planes; // xy planes in the whole job
+	size_t planes_done;
+	size_t num_points; // lattice points evaluated or read so far
+	size_t num_reused; // lattice points taken from the previous job instead of being evaluated
+	size_t num_in_set; // of which this many did not escape
+	size_t num_triangles; // marching cubes triangles so far, before any filtering or simplification
+	double surface_area; // of those triangles
+
+	// Of the points evaluated so far; points from the cache or a previous job have no orbits.
+	// [i] counts the orbits that escaped on iteration i, and [0] those that never escaped. There is one bin
+	// per iteration of the job's count, even when a deadline has the levels run with fewer.
+	vector<size_t> escape_histogram;
+	float min_orbit_magnitude; // smallest and largest magnitude anywhere along any orbit, starting points included
+	float max_orbit_magnitude;
+	bool has_orbit_samples; // whether any orbit has been seen yet; until then the magnitude bounds mean nothing
+
+	double seconds; // since the render started
+	bool from_cache; // nothing was evaluated; the fields came from the cache or a brick volume
+	bool complete; // set in the last call, once every mesh has been written
+};
+
+// Prints the in-set count, surface area, orbit magnitude bounds and escape histogram.
+void print_render_stats(const render_stats& stats);
+
+// Receives the results of a render as they are produced. The default for each is to ignore it.
+// Planes and triangles are the engine's own buffers, handed over without a copy; they are only
+// valid during the call, so copy out anything that is needed later.
+class render_callbacks
+{
+public:
+	virtual ~render_callbacks(void) { }
+
+	// One xy plane of field values for Julia constant c, w slice w: x_res * y_res floats,
+	// with point (x, y) at plane[x * y_res + y]. Called on the rendering thread.
+	virtual void on_field_plane(size_t /*c*/, size_t /*w*/, size_t /*z*/, const float* /*plane*/, size_t /*x_res*/, size_t /*y_res*/) { }
+
+	// A batch of finished triangles for isovalue level of Julia constant c, w slice w, after any
+	// filtering and simplification, with their gradient vertex normals. Called on the output thread,
+	// in order for each mesh.
+	virtual void on_triangles(size_t /*c*/, size_t /*w*/, size_t /*level*/, const triangle_batch& /*batch*/) { }
+
+	// Every triangle of that mesh has been delivered. Called on the output thread.
+	virtual void on_mesh_complete(size_t /*c*/, size_t /*w*/, size_t /*level*/) { }
+
+	// A level of detail is starting; everything until the next call belongs to it. Only called when the
+	// job asks for more than one level, or has a deadline, in which case num_lods is 0 since the number
+	// of levels is not known in advance. Called on the rendering thread.
+	virtual void on_lod_level(size_t /*lod*/, size_t /*num_lods*/, size_t /*x_res*/, size_t /*y_res*/, size_t /*z_res*/) { }
+
+	// After every xy plane, and once more at the end. Called on the rendering thread.
+	virtual void on_stats(const render_stats& /*stats*/) { }
+};
+
+// The buffers that evaluating a slab of lattice points needs. The engine keeps them from one slab,
+// and one job, to the next, so that once they have grown to fit, evaluating allocates nothing.
+class slab_buffers
+{
+public:
+	vector<float> points; // packed as x, y, z, w
+	vector<orbit_summary> orbits;
+	vector<float> fields;
+	vector<float> slab_fields; // the fields of every point of a slab that is evaluated in chunks
+	vector<float> xyplane;
+	vector<size_t> indices; // lattice indices of the points, when they are not whole planes
+};
+
+// Renders jobs, one at a time. The GL context is created the first time a job needs evaluating,
+// and kept for later jobs, along with the evaluator picked by calibration for as long as the
+// jobs keep evaluating the same way. Evaluated fields are kept in the on-disk field cache.
+class julia_engine
+{
+public:
+	// argc and argv are only used if the context falls back to GLUT.
+	julia_engine(int src_argc = 0, char** src_argv = 0);
+	~julia_engine(void);
+
+	// Returns false if the job could not be completed. Messages go to cout.
+	bool render(const render_job& job, render_callbacks* callbacks = 0);
+
+	// Checks that every available evaluator gives the job's fields, instead of rendering it.
+	bool check_evaluator_conformance(const render_job& job);
+
+private:
+	julia_engine(const julia_engine&);
+	julia_engine& operator=(const julia_engine&);
+
+	// Makes evaluators ready for the job, and samples points from its lattice for timing and checking them.
+	// The current evaluators are reused, with the job's field set on them, unless the shaders have to change.
+	bool prepare_evaluators(const render_job& job);
+	bool is_same_evaluation(const render_job& job) const;
+	void release_evaluators(void);
+
+	void open_level_meshes(background_mesh_writer& output, const render_job& job, render_callbacks* callbacks, size_t c, size_t w, size_t num_levels, const vertex_3& bounds_min, const vertex_3& bounds_max);
+
+	// Meshes every field volume straight from the cache, without creating a GL context.
+	// Returns false, having written nothing, unless every volume is cached.
+	bool mesh_cached_field_volumes(const render_job& job, render_callbacks* callbacks, render_stats& stats);
+
+	// Meshes the job's box of lattice points (clipped to the volume) from its input brick volume,
+	// reading only the bricks that the box overlaps.
+	bool mesh_brick_volume(const render_job& job, render_callbacks* callbacks, render_stats& stats);
+
+	// Meshes whole field volumes that are already at hand, with get_plane(w * num_constants + c, z)
+	// giving plane z of the volume for Julia constant c, w slice w, in order, or 0 if it can't be had.
+	// Counts the points in the set and the surface area on the way. Returns false if a plane or a mesh file failed.
+	template<typename plane_function>
+	bool mesh_field_volumes(const render_job& job, render_callbacks* callbacks, render_stats& stats, plane_function get_plane);
+
+	// Starts remembering the job's field volumes, if it is incremental and they fit in the host budget.
+	bool remember_volumes(const render_job& job);
+
+	// Whether the job evaluates the same field as the remembered volumes, on the same lattice translated
+	// by offsets[i] whole steps along each axis, with some overlap, and its volumes fit in the host budget.
+	bool is_translation_of_previous(const render_job& job, long long offsets[3]) const;
+
+	// Moves the overlap into place within the remembered volumes, evaluates only the newly exposed points, and meshes the result.
+	bool evaluate_exposed_and_mesh(const render_job& job, render_callbacks* callbacks, render_stats& stats, const long long offsets[3]);
+
+	// Whether the remembered volumes are the same field on the same bounds, with half the steps of the job along each axis,
+	// and the job's finer volumes fit in the host budget.
+	bool is_coarser_level_of_previous(const render_job& job) const;
+
+	// Grows the remembered coarser volumes to the job's lattice, keeping every other point, evaluates only the rest, and meshes the result.
+	bool evaluate_refined_and_mesh(const render_job& job, render_callbacks* callbacks, render_stats& stats);
+
+	// Renders each level of the job's level of detail pyramid, coarsest first, with one evaluator for them all.
+	bool render_lod_pyramid(const render_job& job, render_callbacks* callbacks, render_stats& stats);
+
+	// Renders the job on the given lattice as level of detail lod, refining the remembered level if it is the next coarser one.
+	bool render_level(const render_job& job, size_t lod, size_t num_lods, size_t x_res, size_t y_res, size_t z_res, render_callbacks* callbacks, render_stats& stats);
+
+	// Renders ever finer levels of detail until the next one would miss the job's deadline.
+	bool render_within_deadline(const render_job& job, render_callbacks* callbacks, render_stats& stats);
+
+	// Walks the lattice plane by plane, evaluating the points (x, y, z) for which is_new(x, y, z) holds into the
+	// remembered volumes, which already hold the rest. Then writes the volumes to the field cache and brick volumes,
+	// as asked, and meshes them. They stay remembered as the job's volumes, unless evaluation fails.
+	template<typename point_predicate>
+	bool evaluate_new_points_and_mesh(const render_job& job, render_callbacks* callbacks, render_stats& stats, point_predicate is_new);
+
+	bool evaluate_and_mesh(const render_job& job, render_callbacks* callbacks, render_stats& stats);
+
+	int argc;
+	char** argv;
+
+	gl_context context;
+	bool tried_context;
+
+	gs_field_evaluator* gs_evaluator;
+	cpu_field_evaluator* cpu_evaluator;
+	vector<field_evaluator*> evaluators;
+	field_evaluator* evaluator;
+	vector<float> sample_points;
+
+	// The number of Julia constants that the evaluators were made for.
+	size_t evaluator_num_constants;
+
+	// All of the time spent making, compiling and calibrating evaluators, so that timings can leave it out.
+	double evaluator_setup_seconds;
+
+	slab_buffers slab;
+
+	// The field volumes of the last job, at [w * num_constants + c], and the job they belong to.
+	render_job previous_job;
+	vector<vector<float>> previous_volumes;
+};
+
+
+#endif
@@ -1,15 +1,5 @@
-#include <GL/glew.h>
-#include <GL/glut.h>
-
-#include "marching_cubes.h"
-using namespace marching_cubes;
-
-#include <glm/vec2.hpp>
-#include <glm/vec3.hpp>
-#include <glm/vec4.hpp>
-#include <glm/mat4x4.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-using namespace glm;
+#include "julia_engine.h"
+#include "render_daemon.h"
 
 // Automatically link in the GLUT and GLEW libraries if compiling on MSVC++
 #ifdef _MSC_VER
@@ -17,521 +7,225 @@ using namespace glm;
 #pragma comment(lib, "freeglut")
 #endif
 
+#include <cstring>
 #include <iostream>
-#include <vector>
+#include <map>
+#include <sstream>
 using namespace std;
 
 
-
-
-#include "vertex_geometry_shader.h"
-
-
-
-
-
-
-bool write_triangles_to_binary_stereo_lithography_file(const vector<triangle>& triangles, const char* const file_name)
+// Writes the meshes that a daemon streams back into files named as a local render would name them.
+class mesh_file_callbacks : public render_callbacks
 {
-	cout << "Triangle count: " << triangles.size() << endl;
-
-	if (0 == triangles.size())
-		return false;
-
-	// Write to file.
-	ofstream out(file_name, ios_base::binary);
-
-	if (out.fail())
-		return false;
-
-	const size_t header_size = 80;
-	vector<char> buffer(header_size, 0);
-	const unsigned int num_triangles = static_cast<unsigned int>(triangles.size()); // Must be 4-byte unsigned int.
-	vertex_3 normal;
+public:
+	mesh_file_callbacks(const render_job& src_job) : job(src_job), num_levels(src_job.get_isovalues().size()), output_name(src_job.output_name) { }
 
-	// Write blank header.
-	out.write(reinterpret_cast<const char*>(&(buffer[0])), header_size);
-
-	// Write number of triangles.
-	out.write(reinterpret_cast<const char*>(&num_triangles), sizeof(unsigned int));
-
-	// Copy everything to a single buffer.
-	// We do this here because calling ofstream::write() only once PER MESH is going to 
-	// send the data to disk faster than if we were to instead call ofstream::write()
-	// thirteen times PER TRIANGLE.
-	// Of course, the trade-off is that we are using 2x the RAM than what's absolutely required,
-	// but the trade-off is often very much worth it (especially so for meshes with millions of triangles).
-	cout << "Generating normal/vertex/attribute buffer" << endl;
-
-	// Enough bytes for twelve 4-byte floats plus one 2-byte integer, per triangle.
-	const size_t data_size = (12 * sizeof(float) + sizeof(short unsigned int)) * num_triangles;
-	buffer.resize(data_size, 0);
-
-	// Use a pointer to assist with the copying.
-	// Should probably use std::copy() instead, but memcpy() does the trick, so whatever...
-	char* cp = &buffer[0];
-
-	for (vector<triangle>::const_iterator i = triangles.begin(); i != triangles.end(); i++)
+	~mesh_file_callbacks(void)
 	{
-		// Get face normal.
-		vertex_3 v0 = i->vertex[1] - i->vertex[0];
-		vertex_3 v1 = i->vertex[2] - i->vertex[0];
-		normal = v0.cross(v1);
-		normal.normalize();
-
-		memcpy(cp, &normal.x, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &normal.y, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &normal.z, sizeof(float)); cp += sizeof(float);
-
-		memcpy(cp, &i->vertex[0].x, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &i->vertex[0].y, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &i->vertex[0].z, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &i->vertex[1].x, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &i->vertex[1].y, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &i->vertex[1].z, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &i->vertex[2].x, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &i->vertex[2].y, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &i->vertex[2].z, sizeof(float)); cp += sizeof(float);
-
-		cp += sizeof(short unsigned int);
+		for (map<size_t, mesh_writer*>::iterator i = writers.begin(); i != writers.end(); i++)
+		{
+			i->second->close();
+			delete i->second;
+		}
 	}
 
-	cout << "Writing " << data_size / 1048576.0f << " MB of data to binary Stereo Lithography file: " << file_name << endl;
-
-	out.write(reinterpret_cast<const char*>(&buffer[0]), data_size);
-	out.close();
-
-	return true;
-}
-
-
-
-void get_trajectories(
-	const vector<float>& point_vertex_data,
-	vector<vector<quaternion>>& trajectories,
-	vertex_geometry_shader& g0_mc_shader,
-	quaternion C,
-	int max_iterations,
-	float threshold)
-{
-	const GLuint components_per_position = 4;
-	const GLuint components_per_vertex = components_per_position;
-
-	GLuint point_buffer;
-
-	glGenBuffers(1, &point_buffer);
-
-	const GLuint num_vertices = static_cast<GLuint>(point_vertex_data.size()) / components_per_vertex;
-
-	glBindBuffer(GL_ARRAY_BUFFER, point_buffer);
-	glBufferData(GL_ARRAY_BUFFER, point_vertex_data.size() * sizeof(GLfloat), &point_vertex_data[0], GL_DYNAMIC_DRAW);
-
-	glEnableVertexAttribArray(glGetAttribLocation(g0_mc_shader.get_program(), "position"));
-	glVertexAttribPointer(glGetAttribLocation(g0_mc_shader.get_program(), "position"),
-		components_per_position,
-		GL_FLOAT,
-		GL_FALSE,
-		components_per_vertex * sizeof(GLfloat),
-		0);
-
-	glUseProgram(g0_mc_shader.get_program());
-
-	glUniform4f(glGetUniformLocation(g0_mc_shader.get_program(), "C"), C.x, C.y, C.z, C.w);
-	glUniform1i(glGetUniformLocation(g0_mc_shader.get_program(), "max_iterations"), max_iterations);
-	glUniform1f(glGetUniformLocation(g0_mc_shader.get_program(), "threshold"), threshold);
-
-	size_t max_output_vertices_per_input = max_iterations + 2;
-
-	size_t max_vertices = max_output_vertices_per_input * num_vertices;
-	size_t num_floats_per_vertex = 4;
-
-	// Allocate enough for the maximum number of vertices
-	GLuint tbo;
-	glGenBuffers(1, &tbo);
-	glBindBuffer(GL_ARRAY_BUFFER, tbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * max_vertices * num_floats_per_vertex, nullptr, GL_STATIC_READ);
-
-	GLuint query;
-	glGenQueries(1, &query);
-
-	// Perform feedback transform
-	glEnable(GL_RASTERIZER_DISCARD);
-
-	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, tbo);
-
-	glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, query);
-	glBeginTransformFeedback(GL_POINTS);
-	glDrawArrays(GL_POINTS, 0, num_vertices);
-	glEndTransformFeedback();
-	glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
-
-	glDisable(GL_RASTERIZER_DISCARD);
-
-	glFlush();
-
-	GLuint primitives;
-	glGetQueryObjectuiv(query, GL_QUERY_RESULT, &primitives);
-
-	// Read back actual number of triangles (in case it's less than two triangles)
-	vector<GLfloat> feedback(primitives * num_floats_per_vertex);
-	glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, sizeof(GLfloat) * feedback.size(), &feedback[0]);
-
-	glDeleteQueries(1, &query);
-	glDeleteBuffers(1, &tbo);
+	void on_triangles(size_t c, size_t w, size_t level, const triangle_batch& batch)
+	{
+		mesh_writer* writer = get_writer(c, w, level);
 
-	vector<quaternion> trajectory;
+		if (0 != writer)
+			writer->write(batch);
+	}
 
-	for (size_t i = 0; i < primitives; i++)
+	void on_mesh_complete(size_t c, size_t w, size_t level)
 	{
-		size_t feedback_index = 4 * i;
+		mesh_writer* writer = get_writer(c, w, level);
 
-		if (feedback[feedback_index + 0] == 10000 &&
-			feedback[feedback_index + 1] == 10000 &&
-			feedback[feedback_index + 2] == 10000 &&
-			feedback[feedback_index + 3] == 10000)
+		if (0 != writer)
 		{
-			trajectories.push_back(trajectory);
-			trajectory.clear();
-		}
-		else
-		{
-			quaternion Q(
-				feedback[feedback_index + 0],
-				feedback[feedback_index + 1],
-				feedback[feedback_index + 2],
-				feedback[feedback_index + 3]);
-
-			trajectory.push_back(Q);
+			writer->close();
+			delete writer;
+			writers.erase(get_stream(c, w, level));
 		}
 	}
-}
 
-void emit_shaders_to_files(const char* const vs_filename, const char* const gs_filename, int max_iterations)
-{
-	ofstream vs_out(vs_filename);
-
-	vs_out << "#version 410 core" << endl;
-
-	vs_out << "// Per-vertex inputs" << endl;
-	vs_out << "layout(location = 0) in vec4 position;" << endl;
-
-	vs_out << "out VS_OUT" << endl;
-	vs_out << "{" << endl;
-	vs_out << "	vec4 position; " << endl;
-	vs_out << "} vs_out;" << endl;
-
-	vs_out << "void main(void)" << endl;
-	vs_out << "{" << endl;
-	vs_out << "	vs_out.position = position; " << endl;
-	vs_out << "}" << endl;
-
-	vs_out.close();
-
-	ofstream gs_out(gs_filename);
-
-	gs_out << "#version 430 core" << endl;
-	gs_out << "" << endl;
-	gs_out << "layout (points) in;" << endl;
-	gs_out << "layout (points) out;" << endl;
-	gs_out << "layout (max_vertices = " << max_iterations + 2 << ") out;" << endl;
-	gs_out << "" << endl;
-	gs_out << "uniform vec4 C;" << endl;
-	gs_out << "uniform int max_iterations;" << endl;
-	gs_out << "uniform float threshold;" << endl;
-	gs_out << "" << endl;
-	gs_out << "out vec4 vert;" << endl;
-	gs_out << "" << endl;
-	gs_out << "in VS_OUT" << endl;
-	gs_out << "{" << endl;
-	gs_out << "    vec4 position;" << endl;
-	gs_out << "} gs_in[];" << endl;
-	gs_out << "" << endl;
-	gs_out << "vec4 inverse_vec4(vec4 in_vec)" << endl;
-	gs_out << "{" << endl;
-	gs_out << "	// inv(a) = conjugate(a) / norm(a)" << endl;
-	gs_out << "" << endl;
-	gs_out << "	float temp_a_norm = in_vec.x*in_vec.x + in_vec.y*in_vec.y + in_vec.z*in_vec.z + in_vec.w*in_vec.w;" << endl;
-	gs_out << "" << endl;
-	gs_out << "    vec4 out_vec;" << endl;
-	gs_out << "" << endl;
-	gs_out << "	out_vec.x =  in_vec.x;" << endl;
-	gs_out << "	out_vec.y = -in_vec.y;" << endl;
-	gs_out << "	out_vec.z = -in_vec.z;" << endl;
-	gs_out << "	out_vec.w = -in_vec.w;" << endl;
-	gs_out << "" << endl;
-	gs_out << "" << endl;
-	gs_out << "	out_vec.x = out_vec.x / temp_a_norm;" << endl;
-	gs_out << "    out_vec.y = out_vec.y / temp_a_norm;" << endl;
-	gs_out << "	out_vec.z = out_vec.z / temp_a_norm;" << endl;
-	gs_out << "	out_vec.w = out_vec.w / temp_a_norm;" << endl;
-	gs_out << "" << endl;
-	gs_out << "    return out_vec;" << endl;
-	gs_out << "}" << endl;
-	gs_out << "" << endl;
-	gs_out << "vec4 pow_vec4(vec4 in_vec, float beta)" << endl;
-	gs_out << "{" << endl;
-	gs_out << "	float fabs_beta = abs(beta);" << endl;
-	gs_out << "" << endl;
-	gs_out << "	float self_dot = in_vec.x * in_vec.x + in_vec.y * in_vec.y + in_vec.z * in_vec.z + in_vec.w * in_vec.w;" << endl;
-	gs_out << "" << endl;
-	gs_out << "	if (self_dot == 0)" << endl;
-	gs_out << "	{" << endl;
-	gs_out << "        return vec4(0, 0, 0, 0);" << endl;
-	gs_out << "	}" << endl;
-	gs_out << "" << endl;
-	gs_out << "	float len = sqrt(self_dot);" << endl;
-	gs_out << "	float self_dot_beta = pow(self_dot, fabs_beta / 2.0f);" << endl;
-	gs_out << "" << endl;
-	gs_out << "	vec4 out_vec;" << endl;
-	gs_out << "" << endl;
-	gs_out << "	out_vec.x = self_dot_beta * cos(fabs_beta * acos(in_vec.x / len));" << endl;
-	gs_out << "	out_vec.y = in_vec.y * self_dot_beta * sin(fabs_beta * acos(in_vec.x / len)) / sqrt(in_vec.y * in_vec.y + in_vec.z * in_vec.z + in_vec.w * in_vec.w);" << endl;
-	gs_out << "	out_vec.z = in_vec.z * self_dot_beta * sin(fabs_beta * acos(in_vec.x / len)) / sqrt(in_vec.y * in_vec.y + in_vec.z * in_vec.z + in_vec.w * in_vec.w);" << endl;
-	gs_out << "	out_vec.w = in_vec.w * self_dot_beta * sin(fabs_beta * acos(in_vec.x / len)) / sqrt(in_vec.y * in_vec.y + in_vec.z * in_vec.z + in_vec.w * in_vec.w);" << endl;
-	gs_out << "" << endl;
-	gs_out << "	if (beta < 0)" << endl;
-	gs_out << "		out_vec = inverse_vec4(out_vec);" << endl;
-	gs_out << "" << endl;
-	gs_out << "	return out_vec;" << endl;
-	gs_out << "}" << endl;
-	gs_out << "" << endl;
-	gs_out << "" << endl;
-	gs_out << "void main(void)" << endl;
-	gs_out << "{" << endl;
-	gs_out << "    vec4 Z = gs_in[0].position;" << endl;
-	gs_out << "		" << endl;
-	gs_out << "    vert = Z;" << endl;
-	gs_out << "    EmitVertex();" << endl;
-	gs_out << "    EndPrimitive();" << endl;
-	gs_out << "" << endl;
-	gs_out << "    for (int i = 0; i < max_iterations; i++)" << endl;
-	gs_out << "    {" << endl;
-	gs_out << "        Z = pow_vec4(Z, 2.0) + C;" << endl;
-	gs_out << "        " << endl;
-	gs_out << "        vert = Z;" << endl;
-	gs_out << "        EmitVertex();" << endl;
-	gs_out << "        EndPrimitive();" << endl;
-	gs_out << "        " << endl;
-	gs_out << "        if (length(Z) >= threshold)" << endl;
-	gs_out << "            break;" << endl;
-	gs_out << "    }" << endl;
-	gs_out << "" << endl;
-	gs_out << "    vec4 sentinel = vec4(10000,10000,10000,10000);" << endl;
-	gs_out << "" << endl;
-	gs_out << "    vert = sentinel;" << endl;
-	gs_out << "    EmitVertex();" << endl;
-	gs_out << "    EndPrimitive();" << endl;
-	gs_out << "}" << endl;
-
-}
-
-int main(int argc, char **argv)
-{
-	glutInit(&argc, argv);
-	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
-	glutInitWindowSize(10, 10);
-	glutInitWindowPosition(0, 0);
-
-	GLint win_id = glutCreateWindow("GS Test");
-
-	if (GLEW_OK != glewInit())
+	void on_stats(const render_stats& src_stats)
 	{
-		cout << "GLEW initialization error" << endl;
-		return 0;
+		stats = src_stats;
 	}
 
-	int GL_major_version = 0;
-	glGetIntegerv(GL_MAJOR_VERSION, &GL_major_version);
-
-	int GL_minor_version = 0;
-	glGetIntegerv(GL_MINOR_VERSION, &GL_minor_version);
-
-	if (GL_major_version < 4)
-	{
-		cout << "GPU does not support OpenGL 4.3 or higher" << endl;
-		return 0;
-	}
-	else if (GL_major_version == 4)
+	void on_lod_level(size_t lod, size_t /*num_lods*/, size_t /*x_res*/, size_t /*y_res*/, size_t /*z_res*/)
 	{
-		if (GL_minor_version < 3)
-		{
-			cout << "GPU does not support OpenGL 4.3 or higher" << endl;
-			return 0;
-		}
+		ostringstream name;
+		name << job.output_name << "_lod" << lod;
+		output_name = name.str();
 	}
 
+	// The latest statistics that the daemon sent.
+	render_stats stats;
 
-	float x_grid_max = 1.5;
-	float y_grid_max = 1.5;
-	float z_grid_max = 1.5;
-	float x_grid_min = -x_grid_max;
-	float y_grid_min = -y_grid_max;
-	float z_grid_min = -z_grid_max;
-	size_t x_res = 100;
-	size_t y_res = 100;
-	size_t z_res = 100;
-
-	float z_w = 0;
-	quaternion C;
-	C.x = 0.3f;
-	C.y = 0.5f;
-	C.z = 0.4f;
-	C.w = 0.2f;
-	int max_iterations = 8;
-	float threshold = 4.0f;
-
-
-	emit_shaders_to_files("points.vs.glsl", "points.gs.glsl", max_iterations);
-
-	vertex_geometry_shader g0_mc_shader;
-
-	if (false == g0_mc_shader.init("points.vs.glsl", "points.gs.glsl", "vert"))
+private:
+	size_t get_stream(size_t c, size_t w, size_t level) const
 	{
-		cout << "Couldn't load shaders" << endl;
-		return 0;
+		return (w * job.C_batch.size() + c) * num_levels + level;
 	}
 
-	g0_mc_shader.use_program();
-
-
-
-	// Make enough data for 1 point
-	vector<float> point_vertex_data;
-
-	const float x_step_size = (x_grid_max - x_grid_min) / (x_res - 1);
-	const float y_step_size = (y_grid_max - y_grid_min) / (y_res - 1);
-	const float z_step_size = (z_grid_max - z_grid_min) / (z_res - 1);
-
-	vector<float> xyplane0(x_res * y_res, 0);
-	vector<float> xyplane1(x_res * y_res, 0);
-	vector<triangle> triangles;
-	size_t box_count = 0;
-
-	size_t z = 0;
+	mesh_writer* get_writer(size_t c, size_t w, size_t level)
+	{
+		const size_t stream = get_stream(c, w, level);
 
-	quaternion Z(x_grid_min, y_grid_min, z_grid_min, z_w);
+		if (writers.count(stream))
+			return writers[stream];
 
-	// Calculate 0th xy plane.
-	for (size_t x = 0; x < x_res; x++, Z.x += x_step_size)
-	{
-		Z.y = y_grid_min;
+		mesh_writer* writer = create_mesh_writer(job.output_format, vertex_3(job.x_grid_min, job.y_grid_min, job.z_grid_min, 0), vertex_3(job.x_grid_max, job.y_grid_max, job.z_grid_max, 0));
+		const string file_name = get_output_file_name(output_name, c, job.C_batch.size(), w, job.w_res, level, num_levels, get_mesh_format_extension(job.output_format));
 
-		for (size_t y = 0; y < y_res; y++, Z.y += y_step_size)
+		if (false == writer->open(file_name.c_str()))
 		{
-			point_vertex_data.push_back(Z.x);
-			point_vertex_data.push_back(Z.y);
-			point_vertex_data.push_back(Z.z);
-			point_vertex_data.push_back(Z.w);
+			cout << "Couldn't open mesh file: " << file_name << endl;
+			delete writer;
+			return 0;
 		}
-	}
-
-	// Prepare for 1st xy plane.
-	z++;
-	Z.z += z_step_size;
-
-	vector<vector<quaternion>> local_trajectories;
 
-	vector<vector<quaternion>> all_trajectories;
-
-	get_trajectories(
-		point_vertex_data,
-		local_trajectories,
-		g0_mc_shader,
-		C,
-		max_iterations,
-		threshold);
-
-	for (size_t i = 0; i < local_trajectories.size(); i++)
-	{
-		if (local_trajectories[i].size() > 0)
-			xyplane0[i] = (local_trajectories[i][local_trajectories[i].size() - 1]).magnitude();
-		else
-			xyplane0[i] = 0;
+		writers[stream] = writer;
 
-		all_trajectories.push_back(local_trajectories[i]);
+		return writer;
 	}
 
+	render_job job;
+	size_t num_levels;
+	string output_name;
+	map<size_t, mesh_writer*> writers;
+};
 
 
-	// Calculate 1st and subsequent xy planes.
-	for (; z < z_res; z++, Z.z += z_step_size)
+int main(int argc, char **argv)
+{
+	render_job job;
+
+	job.x_grid_max = 1.5;
+	job.y_grid_max = 1.5;
+	job.z_grid_max = 1.5;
+	job.x_grid_min = -job.x_grid_max;
+	job.y_grid_min = -job.y_grid_max;
+	job.z_grid_min = -job.z_grid_max;
+	job.x_res = 100;
+	job.y_res = 100;
+	job.z_res = 100;
+
+	// The 4D hyper-volume is sampled as w_res 3D cross-sections, evenly spaced over [w_min, w_max].
+	// Every cross-section gets its own mesh. With w_res = 1 only the w = w_min section is made.
+	job.w_min = 0;
+	job.w_max = 0;
+	job.w_res = 1;
+
+	// Every constant in this batch is evaluated against the same lattice in one instanced draw,
+	// and each produces its own mesh. Add more constants here to sweep C (e.g. for animation frames).
+	job.C_batch.clear();
+	job.C_batch.push_back(quaternion(0.3f, 0.5f, 0.4f, 0.2f));
+
+	job.max_iterations = 8;
+	job.threshold = 4.0f;
+
+	// The smooth potential and distance fields interpolate far better than the raw magnitude,
+	// so a coarser grid gives the same surface quality.
+	job.mode = magnitude_field;
+
+	// A surface is extracted wherever the field crosses one of these values, with one mesh per value.
+	// Left empty, the mode's default isovalue gives the same surface as the magnitude field at threshold.
+	job.isovalues.clear();
+
+	// Upper bounds on the memory used by the evaluator, in bytes.
+	job.budget.device_bytes = 256 * 1048576;
+	job.budget.host_bytes = 1024 * 1048576;
+
+	// Number of slice-pair triangle batches that may wait for the I/O thread.
+	job.output_queue_depth = 16;
+
+	// Binary STL, indexed binary PLY, or the compact quantized format.
+	job.output_format = stl_mesh_format;
+
+	// Drop disconnected pieces of surface with fewer triangles than this, or smaller than this across,
+	// as the mesh streams out. Zero for both writes every piece.
+	job.filter.min_triangles = 0;
+	job.filter.min_extent = 0.0f;
+
+	// Simplify the mesh as it streams out, moving the surface no further than max_error.
+	// Zero writes the marching cubes triangles as they are.
+	job.decimation.max_error = 0.0f;
+	job.decimation.target_ratio = 0.0f;
+	job.decimation.window_batches = 16;
+
+	// Keep every evaluated field volume on disk, keyed by the parameters that produced it.
+	// When every volume a run needs is already cached, the run goes straight to meshing.
+	// The field_*.vol files take 4 bytes per lattice point, and are left for you to delete.
+	job.use_field_cache = false;
+
+	// Also write every field volume out as a compressed brick volume (out[_c][_w<w>].jbv).
+	job.write_brick_volumes = false;
+
+	// Reuse the overlap with the previous job's field when the next job only pans the lattice.
+	job.incremental = true;
+
+	// Output files are named out[_c][_w<w>][_l<level>].
+	job.output_name = "out";
+
+	// Render this many levels of detail, coarsest first, into out_lod<k> files, each reusing the samples
+	// of the one before. Needs every resolution minus one to be divisible by 2^(lod_levels - 1), so use
+	// resolutions like 129 for the most levels. One renders just the job's own lattice into out files.
+	job.lod_levels = 1;
+
+	// If positive, render ever finer levels of detail into out_lod<k> files, up to the lattice and iteration
+	// count above, for as long as the next level is predicted to finish within this many seconds.
+	// A level is never cut short, so a bad prediction can run over by the time of the last level.
+	job.deadline_seconds = 0;
+
+	// If set, just mesh this brick volume, limited to the given box of lattice indices.
+	job.input_brick_volume = "";
+
+	// julia --daemon <socket> [<data directory>] serves render jobs from a warm engine until it is told to shut down.
+	// Clients can only mesh brick volumes that are in the data directory, and the daemon writes no files.
+	// julia --client <socket> renders the job above on the daemon, and writes its meshes here.
+	// julia --metrics <socket> and julia --shutdown <socket> query and stop the daemon.
+	// julia --check-evaluators checks that every evaluator gives the job's field, instead of meshing anything,
+	// and exits with a non-zero status if any of them does not.
+	if (argc > 2 && 0 == strcmp(argv[1], "--client"))
 	{
-		point_vertex_data.clear();
-		Z.x = x_grid_min;
+		mesh_file_callbacks callbacks(job);
 
-		cout << "Calculating triangles from xy-plane pair " << z << " of " << z_res - 1 << endl;
+		if (false == render_on_daemon(argv[2], job, &callbacks))
+			return 1;
 
-		for (size_t x = 0; x < x_res; x++, Z.x += x_step_size)
-		{
-			Z.y = y_grid_min;
-
-			for (size_t y = 0; y < y_res; y++, Z.y += y_step_size)
-			{
-				point_vertex_data.push_back(Z.x);
-				point_vertex_data.push_back(Z.y);
-				point_vertex_data.push_back(Z.z);
-				point_vertex_data.push_back(Z.w);
-			}
-		}
+		print_render_stats(callbacks.stats);
 
-		local_trajectories.clear();
-
-		get_trajectories(
-			point_vertex_data,
-			local_trajectories,
-			g0_mc_shader,
-			C,
-			max_iterations,
-			threshold);
-
-		for (size_t i = 0; i < local_trajectories.size(); i++)
-		{
-			if (local_trajectories[i].size() > 0)
-				xyplane1[i] = (local_trajectories[i][local_trajectories[i].size() - 1]).magnitude();
-			else
-				xyplane1[i] = 0;
-
-			all_trajectories.push_back(local_trajectories[i]);
-		}
-
-		// Calculate triangles for the xy-planes corresponding to z - 1 and z by marching cubes.
-		tesselate_adjacent_xy_plane_pair(
-			box_count,
-			xyplane0, xyplane1,
-			z - 1,
-			triangles,
-			threshold, // Use threshold as isovalue.
-			x_grid_min, x_grid_max, x_res,
-			y_grid_min, y_grid_max, y_res,
-			z_grid_min, z_grid_max, z_res);
-
-		// Swap memory pointers (fast) instead of performing a memory copy (slow).
-		xyplane1.swap(xyplane0);
+		return 0;
 	}
 
-	if (0 < triangles.size())
-		write_triangles_to_binary_stereo_lithography_file(triangles, "out.stl");
+	if (argc > 2 && 0 == strcmp(argv[1], "--metrics"))
+		return print_daemon_metrics(argv[2]) ? 0 : 1;
 
+	if (argc > 2 && 0 == strcmp(argv[1], "--shutdown"))
+		return shut_down_daemon(argv[2]) ? 0 : 1;
 
+	julia_engine engine(argc, argv);
 
-
-	size_t in_set = 0;
-
-	for (size_t i = 0; i < all_trajectories.size(); i++)
+	if (argc > 2 && 0 == strcmp(argv[1], "--daemon"))
 	{
-		if (all_trajectories[i].size() > 0)
-		{
-			quaternion Q = all_trajectories[i][all_trajectories[i].size() - 1];
+		// Jobs beyond this many waiting are turned away.
+		const size_t max_queued_jobs = 64;
 
-			if (Q.magnitude() < threshold)
-				in_set++;
-		}
-	}
+		render_daemon daemon(engine, max_queued_jobs, argc > 3 ? argv[3] : "");
 
-	cout << in_set << " of " << all_trajectories.size() << endl;
+		if (false == daemon.listen(argv[2]))
+			return 1;
 
-	return 0;
-}
+		daemon.run();
 
+		return 0;
+	}
 
+	if (argc > 1 && 0 == strcmp(argv[1], "--check-evaluators"))
+		return engine.check_evaluator_conformance(job) ? 0 : 1;
 
+	return engine.render(job) ? 0 : 1;
+}
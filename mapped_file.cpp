@@ -0,0 +1,262 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+mapped_file::mapped_file(void) : bytes(0), num_bytes(0), file_handle(INVALID_HANDLE_VALUE), mapping_handle(0)
+{
+}
+
+bool mapped_file::create(const char* const file_name, size_t file_size)
+{
+	close();
+
+	if (0 == file_size)
+		return false;
+
+	file_handle = CreateFileA(file_name, GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+
+	if (INVALID_HANDLE_VALUE == file_handle)
+		return false;
+
+	// Creating the mapping at the full size also sizes the file.
+	const unsigned long long size = file_size;
+	mapping_handle = CreateFileMappingA(file_handle, 0, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xffffffff), 0);
+
+	if (0 == mapping_handle)
+	{
+		close();
+		return false;
+	}
+
+	bytes = static_cast<char*>(MapViewOfFile(mapping_handle, FILE_MAP_WRITE, 0, 0, file_size));
+
+	if (0 == bytes)
+	{
+		close();
+		return false;
+	}
+
+	num_bytes = file_size;
+
+	return true;
+}
+
+bool mapped_file::resize(size_t file_size)
+{
+	if (0 == bytes || 0 == file_size)
+		return false;
+
+	// The view and the mapping have to go before the file can change size.
+	UnmapViewOfFile(bytes);
+	CloseHandle(mapping_handle);
+	bytes = 0;
+	mapping_handle = 0;
+
+	LARGE_INTEGER size;
+	size.QuadPart = static_cast<LONGLONG>(file_size);
+
+	if (!SetFilePointerEx(file_handle, size, 0, FILE_BEGIN) || !SetEndOfFile(file_handle))
+	{
+		close();
+		return false;
+	}
+
+	mapping_handle = CreateFileMappingA(file_handle, 0, PAGE_READWRITE, 0, 0, 0);
+
+	if (0 == mapping_handle)
+	{
+		close();
+		return false;
+	}
+
+	bytes = static_cast<char*>(MapViewOfFile(mapping_handle, FILE_MAP_WRITE, 0, 0, file_size));
+
+	if (0 == bytes)
+	{
+		close();
+		return false;
+	}
+
+	num_bytes = file_size;
+
+	return true;
+}
+
+bool mapped_file::open(const char* const file_name)
+{
+	close();
+
+	file_handle = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+
+	if (INVALID_HANDLE_VALUE == file_handle)
+		return false;
+
+	LARGE_INTEGER size;
+
+	if (!GetFileSizeEx(file_handle, &size) || 0 == size.QuadPart)
+	{
+		close();
+		return false;
+	}
+
+	mapping_handle = CreateFileMappingA(file_handle, 0, PAGE_READONLY, 0, 0, 0);
+
+	if (0 == mapping_handle)
+	{
+		close();
+		return false;
+	}
+
+	bytes = static_cast<char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+
+	if (0 == bytes)
+	{
+		close();
+		return false;
+	}
+
+	num_bytes = static_cast<size_t>(size.QuadPart);
+
+	return true;
+}
+
+void mapped_file::close(void)
+{
+	if (0 != bytes)
+		UnmapViewOfFile(bytes);
+
+	if (0 != mapping_handle)
+		CloseHandle(mapping_handle);
+
+	if (INVALID_HANDLE_VALUE != file_handle)
+		CloseHandle(file_handle);
+
+	bytes = 0;
+	num_bytes = 0;
+	mapping_handle = 0;
+	file_handle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+mapped_file::mapped_file(void) : bytes(0), num_bytes(0), file_descriptor(-1)
+{
+}
+
+bool mapped_file::create(const char* const file_name, size_t file_size)
+{
+	close();
+
+	if (0 == file_size)
+		return false;
+
+	file_descriptor = ::open(file_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (-1 == file_descriptor)
+		return false;
+
+	if (0 != ftruncate(file_descriptor, static_cast<off_t>(file_size)))
+	{
+		close();
+		return false;
+	}
+
+	void* p = mmap(0, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+
+	if (MAP_FAILED == p)
+	{
+		close();
+		return false;
+	}
+
+	bytes = static_cast<char*>(p);
+	num_bytes = file_size;
+
+	return true;
+}
+
+bool mapped_file::resize(size_t file_size)
+{
+	if (0 == bytes || 0 == file_size)
+		return false;
+
+	munmap(bytes, num_bytes);
+	bytes = 0;
+
+	if (0 != ftruncate(file_descriptor, static_cast<off_t>(file_size)))
+	{
+		close();
+		return false;
+	}
+
+	void* p = mmap(0, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+
+	if (MAP_FAILED == p)
+	{
+		close();
+		return false;
+	}
+
+	bytes = static_cast<char*>(p);
+	num_bytes = file_size;
+
+	return true;
+}
+
+bool mapped_file::open(const char* const file_name)
+{
+	close();
+
+	file_descriptor = ::open(file_name, O_RDONLY);
+
+	if (-1 == file_descriptor)
+		return false;
+
+	struct stat file_status;
+
+	if (0 != fstat(file_descriptor, &file_status) || 0 == file_status.st_size)
+	{
+		close();
+		return false;
+	}
+
+	void* p = mmap(0, static_cast<size_t>(file_status.st_size), PROT_READ, MAP_SHARED, file_descriptor, 0);
+
+	if (MAP_FAILED == p)
+	{
+		close();
+		return false;
+	}
+
+	bytes = static_cast<char*>(p);
+	num_bytes = static_cast<size_t>(file_status.st_size);
+
+	return true;
+}
+
+void mapped_file::close(void)
+{
+	if (0 != bytes)
+		munmap(bytes, num_bytes);
+
+	if (-1 != file_descriptor)
+		::close(file_descriptor);
+
+	bytes = 0;
+	num_bytes = 0;
+	file_descriptor = -1;
+}
+
+#endif
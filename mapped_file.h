@@ -0,0 +1,47 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef> // g++ chokes on size_t without this
+
+#include <string>
+using std::string;
+
+
+// A file mapped into memory, either created read/write at a fixed size or opened read-only.
+class mapped_file
+{
+public:
+
+	mapped_file(void);
+	~mapped_file(void) { close(); }
+
+	bool create(const char* const file_name, size_t file_size);
+	bool open(const char* const file_name);
+	void close(void);
+
+	// Grows or shrinks a file made by create(), keeping its contents, and maps it again.
+	// data() may move. On failure the file is closed.
+	bool resize(size_t file_size);
+
+	char* data(void) { return bytes; }
+	const char* data(void) const { return bytes; }
+	size_t size(void) const { return num_bytes; }
+	bool is_open(void) const { return 0 != bytes; }
+
+private:
+	mapped_file(const mapped_file&);
+	mapped_file& operator=(const mapped_file&);
+
+	char* bytes;
+	size_t num_bytes;
+
+#ifdef _WIN32
+	void* file_handle;
+	void* mapping_handle;
+#else
+	int file_descriptor;
+#endif
+};
+
+
+#endif
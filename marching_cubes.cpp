@@ -302,228 +302,163 @@ namespace marching_cubes
 
 };
 
-vertex_3 marching_cubes::vertex_interp(const float isovalue, vertex_3 p1, vertex_3 p2, float valp1, float valp2)
+void marching_cubes::tesselate_adjacent_xy_plane_pair(size_t &box_count, const vector<float> &xyplane0, const vector<float> &xyplane1, const size_t z, vector<triangle> &triangles, const float isovalue, const float x_grid_min, const float x_grid_max, const size_t x_res, const float y_grid_min, const float y_grid_max, const size_t y_res, const float z_grid_min, const float z_grid_max, const size_t z_res)
 {
-	// Sort the vertices so that cracks don't mess up the water-tightness of the mesh.
-	// Note: the cracks don't appear if you use doubles instead of floats.
-	if (p2 < p1)
-	{
-		vertex_3 tempv = p2;
-		p2 = p1;
-		p1 = tempv;
-
-		float tempf = valp2;
-		valp2 = valp1;
-		valp1 = tempf;
-	}
+	tesselate_adjacent_xy_plane_pair(box_count, &xyplane0[0], &xyplane1[0], z, triangles, isovalue, x_grid_min, x_grid_max, x_res, y_grid_min, y_grid_max, y_res, z_grid_min, z_grid_max, z_res);
+}
 
-	const float epsilon = 1e-10f;
+// Lattice offsets (x, y, z) of the eight cube corners. Corner i sets bit i of the cube index.
+static const size_t corner_offsets[8][3] =
+{
+    {0, 0, 0}, {1, 0, 0}, {1, 0, 1}, {0, 0, 1},
+    {0, 1, 0}, {1, 1, 0}, {1, 1, 1}, {0, 1, 1}
+};
 
-	if(fabs(isovalue - valp1) < epsilon)
-		return(p1);
+// Each of the twelve edges, in MC_EdgeTable bit order, as its (lower corner, upper corner, axis).
+// The lower corner is the one with the smaller lattice coordinate along the axis, so every cube
+// that shares an edge walks it in the same direction.
+static const int lattice_edges[12][3] =
+{
+    {0, 1, 0}, {1, 2, 2}, {3, 2, 0}, {0, 3, 2},
+    {4, 5, 0}, {5, 6, 2}, {7, 6, 0}, {4, 7, 2},
+    {0, 4, 1}, {1, 5, 1}, {2, 6, 1}, {3, 7, 1}
+};
 
-	if(fabs(isovalue - valp2) < epsilon)
-		return(p2);
+marching_cubes::lattice_frame::lattice_frame(const float x_grid_min, const float x_grid_max, const size_t x_res, const float y_grid_min, const float y_grid_max, const size_t y_res, const float z_grid_min, const float z_grid_max, const size_t z_res)
+{
+    grid_min[0] = x_grid_min;
+    grid_min[1] = y_grid_min;
+    grid_min[2] = z_grid_min;
 
-	if(fabs(valp1 - valp2) < epsilon)
-		return(p1);
+    step_size[0] = (x_grid_max - x_grid_min) / (x_res - 1);
+    step_size[1] = (y_grid_max - y_grid_min) / (y_res - 1);
+    step_size[2] = (z_grid_max - z_grid_min) / (z_res - 1);
+}
 
-	float mu = (isovalue - valp1) / (valp2 - valp1);
+// Sets up the lattice position and corner values of the cube whose lowest corner is lattice point (x, y, z).
+static void load_lattice_cube(marching_cubes::lattice_cube &cube, const size_t x, const size_t y, const size_t z, const float *const xyplane0, const float *const xyplane1, const size_t y_res)
+{
+    cube.x = x;
+    cube.y = y;
+    cube.z = z;
 
-	return p1 + (p2 - p1)*mu;
+    for(size_t i = 0; i < 8; i++)
+    {
+        const size_t index = (x + corner_offsets[i][0])*y_res + (y + corner_offsets[i][1]);
+        cube.value[i] = (0 == corner_offsets[i][2]) ? xyplane0[index] : xyplane1[index];
+    }
 }
 
-short unsigned int marching_cubes::tesselate_grid_cube(const float isovalue, const grid_cube &grid, triangle *const triangles)
+// Finds where the surface crosses edge e of the cube, as a fraction of the way from its lower corner
+// to its upper one. The same corner values in the same order give the same fraction in every cube.
+static float get_edge_crossing(const float isovalue, const marching_cubes::lattice_cube &cube, const int e)
 {
-	short unsigned int cubeindex = 0;
+    const float value0 = cube.value[lattice_edges[e][0]];
+    const float value1 = cube.value[lattice_edges[e][1]];
+
+    const float epsilon = 1e-10f;
+
+    if(fabs(isovalue - value0) < epsilon)
+        return 0.0f;
+
+    if(fabs(isovalue - value1) < epsilon)
+        return 1.0f;
 
-	if(grid.value[0] < isovalue) cubeindex |= 1;
-	if(grid.value[1] < isovalue) cubeindex |= 2;
-	if(grid.value[2] < isovalue) cubeindex |= 4;
-	if(grid.value[3] < isovalue) cubeindex |= 8;
-	if(grid.value[4] < isovalue) cubeindex |= 16;
-	if(grid.value[5] < isovalue) cubeindex |= 32;
-	if(grid.value[6] < isovalue) cubeindex |= 64;
-	if(grid.value[7] < isovalue) cubeindex |= 128;
+    if(fabs(value0 - value1) < epsilon)
+        return 0.0f;
 
-	if(0 == MC_EdgeTable[cubeindex])
-		return 0;
+    return (isovalue - value0) / (value1 - value0);
+}
 
-	vertex_3 vertlist[12];
+short unsigned int marching_cubes::tesselate_lattice_cube(const float isovalue, const lattice_cube &cube, const lattice_frame &frame, triangle *const triangles, vertex_3 *const normals)
+{
+    short unsigned int cubeindex = 0;
 
-	if(MC_EdgeTable[cubeindex] & 1)
-		vertlist[0] = vertex_interp(isovalue, grid.vertex[0], grid.vertex[1], grid.value[0], grid.value[1]);
+    for(int i = 0; i < 8; i++)
+        if(cube.value[i] < isovalue)
+            cubeindex |= (1 << i);
 
-	if(MC_EdgeTable[cubeindex] & 2)
-		vertlist[1] = vertex_interp(isovalue, grid.vertex[1], grid.vertex[2], grid.value[1], grid.value[2]);
+    if(0 == MC_EdgeTable[cubeindex])
+        return 0;
 
-	if(MC_EdgeTable[cubeindex] & 4)
-		vertlist[2] = vertex_interp(isovalue, grid.vertex[2], grid.vertex[3], grid.value[2], grid.value[3]);
+    const size_t lattice_min[3] = { cube.x, cube.y, cube.z };
 
-	if(MC_EdgeTable[cubeindex] & 8)
-		vertlist[3] = vertex_interp(isovalue, grid.vertex[3], grid.vertex[0], grid.value[3], grid.value[0]);
+    vertex_3 vertlist[12];
+    vertex_3 normlist[12];
 
-	if(MC_EdgeTable[cubeindex] & 16)
-		vertlist[4] = vertex_interp(isovalue, grid.vertex[4], grid.vertex[5], grid.value[4], grid.value[5]);
+    for(int e = 0; e < 12; e++)
+    {
+        if(0 == (MC_EdgeTable[cubeindex] & (1 << e)))
+            continue;
 
-	if(MC_EdgeTable[cubeindex] & 32)
-		vertlist[5] = vertex_interp(isovalue, grid.vertex[5], grid.vertex[6], grid.value[5], grid.value[6]);
+        const int lower = lattice_edges[e][0];
+        const int upper = lattice_edges[e][1];
+        const int axis = lattice_edges[e][2];
 
-	if(MC_EdgeTable[cubeindex] & 64)
-		vertlist[6] = vertex_interp(isovalue, grid.vertex[6], grid.vertex[7], grid.value[6], grid.value[7]);
+        const float t = get_edge_crossing(isovalue, cube, e);
 
-	if(MC_EdgeTable[cubeindex] & 128)
-		vertlist[7] = vertex_interp(isovalue, grid.vertex[7], grid.vertex[4], grid.value[7], grid.value[4]);
+        // Only now does the crossing leave the lattice for world space.
+        float position[3];
 
-	if(MC_EdgeTable[cubeindex] & 256)
-		vertlist[8] = vertex_interp(isovalue, grid.vertex[0], grid.vertex[4], grid.value[0], grid.value[4]);
+        for(int i = 0; i < 3; i++)
+            position[i] = frame.grid_min[i] + (lattice_min[i] + corner_offsets[lower][i]) * frame.step_size[i];
 
-	if(MC_EdgeTable[cubeindex] & 512)
-		vertlist[9] = vertex_interp(isovalue, grid.vertex[1], grid.vertex[5], grid.value[1], grid.value[5]);
+        position[axis] += t * frame.step_size[axis];
 
-	if(MC_EdgeTable[cubeindex] & 1024)
-		vertlist[10] = vertex_interp(isovalue, grid.vertex[2], grid.vertex[6], grid.value[2], grid.value[6]);
+        vertlist[e].x = position[0];
+        vertlist[e].y = position[1];
+        vertlist[e].z = position[2];
 
-	if(MC_EdgeTable[cubeindex] & 2048)
-		vertlist[11] = vertex_interp(isovalue, grid.vertex[3], grid.vertex[7], grid.value[3], grid.value[7]);
+        if(0 != normals)
+        {
+            const vertex_3 &g0 = cube.gradient[lower];
+            const vertex_3 &g1 = cube.gradient[upper];
+
+            vertex_3 &n = normlist[e];
+            n.x = g0.x + (g1.x - g0.x)*t;
+            n.y = g0.y + (g1.y - g0.y)*t;
+            n.z = g0.z + (g1.z - g0.z)*t;
+            n.normalize();
+        }
+    }
 
-	short unsigned int ntriang = 0;
+    short unsigned int ntriang = 0;
 
-	for(short unsigned int i = 0; MC_TriTable[cubeindex][i] != -1; i += 3)
-	{
-		triangles[ntriang].vertex[0] = vertlist[MC_TriTable[cubeindex][i  ]];
-		triangles[ntriang].vertex[1] = vertlist[MC_TriTable[cubeindex][i+1]];
-		triangles[ntriang].vertex[2] = vertlist[MC_TriTable[cubeindex][i+2]];
-		ntriang++;
-	}
+    for(short unsigned int i = 0; MC_TriTable[cubeindex][i] != -1; i += 3)
+    {
+        triangles[ntriang].vertex[0] = vertlist[MC_TriTable[cubeindex][i  ]];
+        triangles[ntriang].vertex[1] = vertlist[MC_TriTable[cubeindex][i+1]];
+        triangles[ntriang].vertex[2] = vertlist[MC_TriTable[cubeindex][i+2]];
 
-	return ntriang;
+        if(0 != normals)
+        {
+            normals[3*ntriang    ] = normlist[MC_TriTable[cubeindex][i  ]];
+            normals[3*ntriang + 1] = normlist[MC_TriTable[cubeindex][i+1]];
+            normals[3*ntriang + 2] = normlist[MC_TriTable[cubeindex][i+2]];
+        }
+
+        ntriang++;
+    }
+
+    return ntriang;
 }
 
-void marching_cubes::tesselate_adjacent_xy_plane_pair(size_t &box_count, const vector<float> &xyplane0, const vector<float> &xyplane1, const size_t z, vector<triangle> &triangles, const float isovalue, const float x_grid_min, const float x_grid_max, const size_t x_res, const float y_grid_min, const float y_grid_max, const size_t y_res, const float z_grid_min, const float z_grid_max, const size_t z_res)
+void marching_cubes::tesselate_adjacent_xy_plane_pair(size_t &box_count, const float *const xyplane0, const float *const xyplane1, const size_t z, vector<triangle> &triangles, const float isovalue, const float x_grid_min, const float x_grid_max, const size_t x_res, const float y_grid_min, const float y_grid_max, const size_t y_res, const float z_grid_min, const float z_grid_max, const size_t z_res)
 {
-    const float x_step_size = (x_grid_max - x_grid_min) / (x_res - 1);
-    const float y_step_size = (y_grid_max - y_grid_min) / (y_res - 1);
-    const float z_step_size = (z_grid_max - z_grid_min) / (z_res - 1);
+    const lattice_frame frame(x_grid_min, x_grid_max, x_res, y_grid_min, y_grid_max, y_res, z_grid_min, z_grid_max, z_res);
  
     for(size_t x = 0; x < x_res - 1; x++)
     {
         for(size_t y = 0; y < y_res - 1; y++)
         {
-            grid_cube temp_cube;
- 
-            size_t x_offset = 0;
-            size_t y_offset = 0;
-            size_t z_offset = 0;
- 
-            // Setup vertex 0
-            x_offset = 0;
-            y_offset = 0;
-            z_offset = 0;
-            temp_cube.vertex[0].x = x_grid_min + ((x+x_offset) * x_step_size);
-            temp_cube.vertex[0].y = y_grid_min + ((y+y_offset) * y_step_size);
-            temp_cube.vertex[0].z = z_grid_min + ((z+z_offset) * z_step_size);
- 
-            if(0 == z_offset)
-                temp_cube.value[0] = xyplane0[(x + x_offset)*y_res + (y + y_offset)];
-            else
-                temp_cube.value[0] = xyplane1[(x + x_offset)*y_res + (y + y_offset)];
- 
-            // Setup vertex 1
-            x_offset = 1;
-            y_offset = 0;
-            z_offset = 0;
-            temp_cube.vertex[1].x = x_grid_min + ((x+x_offset) * x_step_size);
-            temp_cube.vertex[1].y = y_grid_min + ((y+y_offset) * y_step_size);
-            temp_cube.vertex[1].z = z_grid_min + ((z+z_offset) * z_step_size);
- 
-            if(0 == z_offset)
-                temp_cube.value[1] = xyplane0[(x + x_offset)*y_res + (y + y_offset)];
-            else
-                temp_cube.value[1] = xyplane1[(x + x_offset)*y_res + (y + y_offset)];
- 
-            // Setup vertex 2
-            x_offset = 1;
-            y_offset = 0;
-            z_offset = 1;
-            temp_cube.vertex[2].x = x_grid_min + ((x+x_offset) * x_step_size);
-            temp_cube.vertex[2].y = y_grid_min + ((y+y_offset) * y_step_size);
-            temp_cube.vertex[2].z = z_grid_min + ((z+z_offset) * z_step_size);
- 
-            if(0 == z_offset)
-                temp_cube.value[2] = xyplane0[(x + x_offset)*y_res + (y + y_offset)];
-            else
-                temp_cube.value[2] = xyplane1[(x + x_offset)*y_res + (y + y_offset)];
- 
-            // Setup vertex 3
-            x_offset = 0; 
-            y_offset = 0;
-            z_offset = 1;
-            temp_cube.vertex[3].x = x_grid_min + ((x+x_offset) * x_step_size);
-            temp_cube.vertex[3].y = y_grid_min + ((y+y_offset) * y_step_size);
-            temp_cube.vertex[3].z = z_grid_min + ((z+z_offset) * z_step_size);
- 
-            if(0 == z_offset)
-                temp_cube.value[3] = xyplane0[(x + x_offset)*y_res + (y + y_offset)];
-            else
-                temp_cube.value[3] = xyplane1[(x + x_offset)*y_res + (y + y_offset)];
- 
-            // Setup vertex 4
-            x_offset = 0;
-            y_offset = 1;
-            z_offset = 0;
-            temp_cube.vertex[4].x = x_grid_min + ((x+x_offset) * x_step_size);
-            temp_cube.vertex[4].y = y_grid_min + ((y+y_offset) * y_step_size);
-            temp_cube.vertex[4].z = z_grid_min + ((z+z_offset) * z_step_size);
- 
-            if(0 == z_offset)
-                temp_cube.value[4] = xyplane0[(x + x_offset)*y_res + (y + y_offset)];
-            else
-                temp_cube.value[4] = xyplane1[(x + x_offset)*y_res + (y + y_offset)];
- 
-            // Setup vertex 5
-            x_offset = 1;
-            y_offset = 1;
-            z_offset = 0;
-            temp_cube.vertex[5].x = x_grid_min + ((x+x_offset) * x_step_size);
-            temp_cube.vertex[5].y = y_grid_min + ((y+y_offset) * y_step_size);
-            temp_cube.vertex[5].z = z_grid_min + ((z+z_offset) * z_step_size);
- 
-            if(0 == z_offset)
-                temp_cube.value[5] = xyplane0[(x + x_offset)*y_res + (y + y_offset)];
-            else
-                temp_cube.value[5] = xyplane1[(x + x_offset)*y_res + (y + y_offset)];
- 
-            // Setup vertex 6
-            x_offset = 1;
-            y_offset = 1;
-            z_offset = 1;
-            temp_cube.vertex[6].x = x_grid_min + ((x+x_offset) * x_step_size);
-            temp_cube.vertex[6].y = y_grid_min + ((y+y_offset) * y_step_size);
-            temp_cube.vertex[6].z = z_grid_min + ((z+z_offset) * z_step_size);
- 
-            if(0 == z_offset)
-                temp_cube.value[6] = xyplane0[(x + x_offset)*y_res + (y + y_offset)];
-            else
-                temp_cube.value[6] = xyplane1[(x + x_offset)*y_res + (y + y_offset)];
- 
-            // Setup vertex 7
-            x_offset = 0;
-            y_offset = 1;
-            z_offset = 1;
-            temp_cube.vertex[7].x = x_grid_min + ((x+x_offset) * x_step_size);
-            temp_cube.vertex[7].y = y_grid_min + ((y+y_offset) * y_step_size);
-            temp_cube.vertex[7].z = z_grid_min + ((z+z_offset) * z_step_size);
- 
-            if(0 == z_offset)
-                temp_cube.value[7] = xyplane0[(x + x_offset)*y_res + (y + y_offset)];
-            else
-                temp_cube.value[7] = xyplane1[(x + x_offset)*y_res + (y + y_offset)];
- 
+            lattice_cube temp_cube;
+
+            load_lattice_cube(temp_cube, x, y, z, xyplane0, xyplane1, y_res);
+
             // Generate triangles from cube.
-            static triangle temp_triangle_array[5];
+            triangle temp_triangle_array[5];
  
-            short unsigned int number_of_triangles_generated = tesselate_grid_cube(isovalue, temp_cube, temp_triangle_array);
+            short unsigned int number_of_triangles_generated = tesselate_lattice_cube(isovalue, temp_cube, frame, temp_triangle_array);
  
 			if (number_of_triangles_generated > 0)
 				box_count++;
@@ -534,3 +469,178 @@ void marching_cubes::tesselate_adjacent_xy_plane_pair(size_t &box_count, const v
     }
 }
 
+void marching_cubes::tesselate_adjacent_xy_plane_pair(vector<size_t> &box_counts, const float *const xyplane0, const float *const xyplane1, const size_t z, vector<triangle_batch> &triangles, const vector<float> &isovalues, const float x_grid_min, const float x_grid_max, const size_t x_res, const float y_grid_min, const float y_grid_max, const size_t y_res, const float z_grid_min, const float z_grid_max, const size_t z_res)
+{
+    tesselate_adjacent_xy_plane_pair(box_counts, xyplane0, xyplane1, 0, 0, z, triangles, isovalues, x_grid_min, x_grid_max, x_res, y_grid_min, y_grid_max, y_res, z_grid_min, z_grid_max, z_res);
+}
+
+void marching_cubes::tesselate_adjacent_xy_plane_pair(vector<size_t> &box_counts, const float *const xyplane0, const float *const xyplane1, const vertex_3 *const gradients0, const vertex_3 *const gradients1, const size_t z, vector<triangle_batch> &triangles, const vector<float> &isovalues, const float x_grid_min, const float x_grid_max, const size_t x_res, const float y_grid_min, const float y_grid_max, const size_t y_res, const float z_grid_min, const float z_grid_max, const size_t z_res)
+{
+    const bool interpolate_normals = (0 != gradients0 && 0 != gradients1);
+
+    const lattice_frame frame(x_grid_min, x_grid_max, x_res, y_grid_min, y_grid_max, y_res, z_grid_min, z_grid_max, z_res);
+
+    box_counts.resize(isovalues.size(), 0);
+    triangles.resize(isovalues.size());
+
+    for(size_t x = 0; x < x_res - 1; x++)
+    {
+        for(size_t y = 0; y < y_res - 1; y++)
+        {
+            // The corners are loaded once and shared by every isovalue.
+            lattice_cube temp_cube;
+
+            load_lattice_cube(temp_cube, x, y, z, xyplane0, xyplane1, y_res);
+
+            float min_value = temp_cube.value[0];
+            float max_value = temp_cube.value[0];
+
+            for(size_t i = 1; i < 8; i++)
+            {
+                if(temp_cube.value[i] < min_value)
+                    min_value = temp_cube.value[i];
+                else if(temp_cube.value[i] > max_value)
+                    max_value = temp_cube.value[i];
+            }
+
+            size_t level_count = 0;
+
+            for(size_t level = 0; level < isovalues.size(); level++)
+            {
+                // The surface only passes through the cube if some corners are below
+                // the isovalue and some are not.
+                if(!(min_value < isovalues[level]) || max_value < isovalues[level])
+                    continue;
+
+                // Only cubes that the surface passes through need their gradients.
+                if(interpolate_normals && 0 == level_count)
+                {
+                    for(size_t i = 0; i < 8; i++)
+                    {
+                        const size_t index = (x + corner_offsets[i][0])*y_res + (y + corner_offsets[i][1]);
+                        temp_cube.gradient[i] = (0 == corner_offsets[i][2]) ? gradients0[index] : gradients1[index];
+                    }
+                }
+
+                level_count++;
+
+                triangle temp_triangle_array[5];
+                vertex_3 temp_normal_array[15];
+
+                short unsigned int number_of_triangles_generated = tesselate_lattice_cube(isovalues[level], temp_cube, frame, temp_triangle_array, interpolate_normals ? temp_normal_array : 0);
+
+                if (number_of_triangles_generated > 0)
+                    box_counts[level]++;
+
+                for(short unsigned int i = 0; i < number_of_triangles_generated; i++)
+                    triangles[level].triangles.push_back(temp_triangle_array[i]);
+
+                if(interpolate_normals)
+                    triangles[level].normals.insert(triangles[level].normals.end(), temp_normal_array, temp_normal_array + 3*number_of_triangles_generated);
+            }
+        }
+    }
+}
+
+
+
+marching_cubes::xy_plane_window::xy_plane_window(const vector<float> &src_isovalues, const float src_x_grid_min, const float src_x_grid_max, const size_t src_x_res, const float src_y_grid_min, const float src_y_grid_max, const size_t src_y_res, const float src_z_grid_min, const float src_z_grid_max, const size_t src_z_res, const bool src_interpolate_normals)
+    : isovalues(src_isovalues),
+    x_grid_min(src_x_grid_min), x_grid_max(src_x_grid_max), x_res(src_x_res),
+    y_grid_min(src_y_grid_min), y_grid_max(src_y_grid_max), y_res(src_y_res),
+    z_grid_min(src_z_grid_min), z_grid_max(src_z_grid_max), z_res(src_z_res),
+    interpolate_normals(src_interpolate_normals)
+{
+    for(size_t i = 0; i < 3; i++)
+    {
+        planes[i].resize(x_res*y_res, 0);
+
+        if(interpolate_normals)
+            gradients[i].resize(x_res*y_res);
+    }
+}
+
+size_t marching_cubes::xy_plane_window::push(const float *const xyplane, const size_t z, vector<size_t> &box_counts, vector<triangle_batch> &triangles)
+{
+    vector<float> &plane = planes[z % 3];
+    plane.assign(xyplane, xyplane + x_res*y_res);
+
+    size_t num_pairs = 0;
+
+    // Plane z - 1 now has both of its neighbours.
+    if(z > 0 && interpolate_normals)
+        calculate_gradients(z - 1);
+
+    if(z > 1)
+    {
+        tesselate(z - 2, box_counts, triangles);
+        num_pairs++;
+    }
+
+    // The last plane has no neighbour above, so finish off the volume.
+    if(z == z_res - 1 && z > 0)
+    {
+        if(interpolate_normals)
+            calculate_gradients(z);
+
+        tesselate(z - 1, box_counts, triangles);
+        num_pairs++;
+    }
+
+    return num_pairs;
+}
+
+void marching_cubes::xy_plane_window::calculate_gradients(const size_t z)
+{
+    const float x_step_size = (x_grid_max - x_grid_min) / (x_res - 1);
+    const float y_step_size = (y_grid_max - y_grid_min) / (y_res - 1);
+    const float z_step_size = (z_grid_max - z_grid_min) / (z_res - 1);
+
+    // Central differences inside the volume, one-sided differences on its faces.
+    const float *const plane = &planes[z % 3][0];
+    const float *const below = (z > 0) ? &planes[(z - 1) % 3][0] : plane;
+    const float *const above = (z < z_res - 1) ? &planes[(z + 1) % 3][0] : plane;
+    const float z_span = ((below != plane) + (above != plane)) * z_step_size;
+
+    vertex_3 *const g = &gradients[z % 3][0];
+
+    for(size_t x = 0; x < x_res; x++)
+    {
+        const size_t x0 = (x > 0) ? x - 1 : x;
+        const size_t x1 = (x < x_res - 1) ? x + 1 : x;
+        const float x_span = (x1 - x0) * x_step_size;
+
+        for(size_t y = 0; y < y_res; y++)
+        {
+            const size_t y0 = (y > 0) ? y - 1 : y;
+            const size_t y1 = (y < y_res - 1) ? y + 1 : y;
+            const float y_span = (y1 - y0) * y_step_size;
+
+            const size_t index = x*y_res + y;
+
+            vertex_3 &n = g[index];
+            n.x = (plane[x1*y_res + y] - plane[x0*y_res + y]) / x_span;
+            n.y = (plane[x*y_res + y1] - plane[x*y_res + y0]) / y_span;
+            n.z = (above[index] - below[index]) / z_span;
+
+            // The field varies over many orders of magnitude near the set, so only the
+            // direction is kept. That way the interpolation is not dominated by one corner.
+            n.normalize();
+        }
+    }
+}
+
+void marching_cubes::xy_plane_window::tesselate(const size_t z, vector<size_t> &box_counts, vector<triangle_batch> &triangles)
+{
+    tesselate_adjacent_xy_plane_pair(
+        box_counts,
+        &planes[z % 3][0], &planes[(z + 1) % 3][0],
+        interpolate_normals ? &gradients[z % 3][0] : 0,
+        interpolate_normals ? &gradients[(z + 1) % 3][0] : 0,
+        z,
+        triangles,
+        isovalues,
+        x_grid_min, x_grid_max, x_res,
+        y_grid_min, y_grid_max, y_res,
+        z_grid_min, z_grid_max, z_res);
+}
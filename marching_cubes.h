@@ -31,16 +31,75 @@ using std::set;
 
 namespace marching_cubes
 {
-	class grid_cube
+	// A cube of a regular lattice, named by the lattice coordinates of its lowest corner,
+	// with its corners in Paul Bourke's order.
+	class lattice_cube
 	{
 	public:
-		vertex_3 vertex[8];
+		size_t x, y, z;
 		float value[8];
+		vertex_3 gradient[8];
 	};
 
-	vertex_3 vertex_interp(const float isovalue, vertex_3 p1, vertex_3 p2, float valp1, float valp2);
-	short unsigned int tesselate_grid_cube(const float isovalue, const grid_cube &grid, triangle *const triangles);
+	// Where lattice point (x, y, z) is in world space: grid_min + (x, y, z) * step_size.
+	class lattice_frame
+	{
+	public:
+		lattice_frame(const float x_grid_min, const float x_grid_max, const size_t x_res, const float y_grid_min, const float y_grid_max, const size_t y_res, const float z_grid_min, const float z_grid_max, const size_t z_res);
+
+		float grid_min[3];
+		float step_size[3];
+	};
+
+	// Writes the cube's triangles, and returns how many there are. Every edge is keyed by its lower lattice
+	// corner and axis, and the crossing is found going from that corner to the upper one, then converted to
+	// world space. Every cube sharing an edge so gets the same vertex, bit for bit, without sorting the corners.
+	// If normals is not 0, it gets three unit vertex normals per triangle, interpolated from the cube's gradients.
+	short unsigned int tesselate_lattice_cube(const float isovalue, const lattice_cube &cube, const lattice_frame &frame, triangle *const triangles, vertex_3 *const normals = 0);
 	void tesselate_adjacent_xy_plane_pair(size_t &box_count, const vector<float> &xyplane0, const vector<float> &xyplane1, const size_t z, vector<triangle> &triangles, const float isovalue, const float x_grid_min, const float x_grid_max, const size_t x_res, const float y_grid_min, const float y_grid_max, const size_t y_res, const float z_grid_min, const float z_grid_max, const size_t z_res);
+	void tesselate_adjacent_xy_plane_pair(size_t &box_count, const float *const xyplane0, const float *const xyplane1, const size_t z, vector<triangle> &triangles, const float isovalue, const float x_grid_min, const float x_grid_max, const size_t x_res, const float y_grid_min, const float y_grid_max, const size_t y_res, const float z_grid_min, const float z_grid_max, const size_t z_res);
+
+	// Extracts one surface per isovalue from the same pair of planes in a single sweep.
+	// triangles[i] and box_counts[i] receive the output for isovalues[i].
+	void tesselate_adjacent_xy_plane_pair(vector<size_t> &box_counts, const float *const xyplane0, const float *const xyplane1, const size_t z, vector<triangle_batch> &triangles, const vector<float> &isovalues, const float x_grid_min, const float x_grid_max, const size_t x_res, const float y_grid_min, const float y_grid_max, const size_t y_res, const float z_grid_min, const float z_grid_max, const size_t z_res);
+
+	// As above, and also interpolates per-vertex normals from the unit field gradients of both planes
+	// into the batches' normals.
+	void tesselate_adjacent_xy_plane_pair(vector<size_t> &box_counts, const float *const xyplane0, const float *const xyplane1, const vertex_3 *const gradients0, const vertex_3 *const gradients1, const size_t z, vector<triangle_batch> &triangles, const vector<float> &isovalues, const float x_grid_min, const float x_grid_max, const size_t x_res, const float y_grid_min, const float y_grid_max, const size_t y_res, const float z_grid_min, const float z_grid_max, const size_t z_res);
+
+	// Feeds a volume to marching cubes one xy plane at a time, keeping a rolling window of the last
+	// three planes so that the field gradient at every lattice point can be found by central differences.
+	// A plane pair is tessellated once the plane after it has arrived, so its normals are smooth
+	// without a second pass over the mesh or over the field.
+	// Without interpolate_normals no gradients are found, and the batches are left without vertex normals,
+	// for output such as STL that only has face normals.
+	class xy_plane_window
+	{
+	public:
+		xy_plane_window(const vector<float> &src_isovalues, const float src_x_grid_min, const float src_x_grid_max, const size_t src_x_res, const float src_y_grid_min, const float src_y_grid_max, const size_t src_y_res, const float src_z_grid_min, const float src_z_grid_max, const size_t src_z_res, const bool src_interpolate_normals = true);
+
+		// Copies in plane z, which must follow plane z - 1 (or start a new volume, if z is 0),
+		// and tessellates the plane pairs that are now complete. Returns how many were tessellated:
+		// none for the first two planes, two for the last plane, and one otherwise.
+		size_t push(const float *const xyplane, const size_t z, vector<size_t> &box_counts, vector<triangle_batch> &triangles);
+
+	private:
+		void calculate_gradients(const size_t z);
+		void tesselate(const size_t z, vector<size_t> &box_counts, vector<triangle_batch> &triangles);
+
+		vector<float> isovalues;
+		float x_grid_min, x_grid_max;
+		size_t x_res;
+		float y_grid_min, y_grid_max;
+		size_t y_res;
+		float z_grid_min, z_grid_max;
+		size_t z_res;
+		bool interpolate_normals;
+
+		// Plane z and its gradients live in slot z % 3.
+		vector<float> planes[3];
+		vector<vertex_3> gradients[3];
+	};
 };
 
 #endif
@@ -0,0 +1,836 @@
+#include "mesh_filter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <queue>
+using namespace std;
+
+
+component_filter_writer::component_filter_writer(mesh_writer* const src_writer, const component_filter_settings& src_settings)
+	: writer(src_writer), settings(src_settings), num_deferred_triangles(0), num_dropped_components(0), num_dropped_triangles(0)
+{
+}
+
+component_filter_writer::~component_filter_writer(void)
+{
+	delete writer;
+}
+
+bool component_filter_writer::open(const char* const file_name)
+{
+	parents.clear();
+	components.clear();
+	previous.clear();
+	current.clear();
+	num_deferred_triangles = 0;
+	num_dropped_components = 0;
+	num_dropped_triangles = 0;
+
+	return writer->open(file_name);
+}
+
+bool component_filter_writer::write(const triangle_batch& batch)
+{
+	output.clear();
+
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		const triangle& t = batch.triangles[i];
+		const size_t none = static_cast<size_t>(-1);
+
+		size_t id = none;
+
+		// Join every component that this triangle shares a vertex with.
+		for (size_t j = 0; j < 3; j++)
+		{
+			component_map::const_iterator v = current.find(t.vertex[j]);
+
+			if (v == current.end())
+			{
+				v = previous.find(t.vertex[j]);
+
+				if (v == previous.end())
+					continue;
+			}
+
+			const size_t other = find(v->second);
+			id = (none == id) ? other : merge(id, other);
+		}
+
+		if (none == id)
+		{
+			id = components.size();
+			parents.push_back(id);
+			components.push_back(component());
+		}
+
+		add_triangle(id, batch, i);
+
+		for (size_t j = 0; j < 3; j++)
+			current[t.vertex[j]] = id;
+	}
+
+	end_batch();
+	release_deferred();
+
+	return writer->write(output);
+}
+
+bool component_filter_writer::close(void)
+{
+	// Nothing can grow any more, so every undecided component is too small.
+	current.clear();
+	end_batch();
+
+	cout << "Dropped " << num_dropped_components << " small component(s), " << num_dropped_triangles << " triangle(s)" << endl;
+
+	return writer->close();
+}
+
+void component_filter_writer::abandon(void)
+{
+	writer->abandon();
+}
+
+size_t component_filter_writer::find(size_t id)
+{
+	size_t root = id;
+
+	while (parents[root] != root)
+		root = parents[root];
+
+	// Point the whole path straight at the root.
+	while (parents[id] != root)
+	{
+		const size_t next = parents[id];
+		parents[id] = root;
+		id = next;
+	}
+
+	return root;
+}
+
+size_t component_filter_writer::merge(size_t a, size_t b)
+{
+	if (a == b)
+		return a;
+
+	// Keep whichever has the longer list of held-back triangles, to copy as few as possible.
+	if (components[a].pending.size() < components[b].pending.size())
+	{
+		const size_t temp = a;
+		a = b;
+		b = temp;
+	}
+
+	component& into = components[a];
+	component& from = components[b];
+
+	into.num_triangles += from.num_triangles;
+
+	into.bounds_min.x = min(into.bounds_min.x, from.bounds_min.x);
+	into.bounds_min.y = min(into.bounds_min.y, from.bounds_min.y);
+	into.bounds_min.z = min(into.bounds_min.z, from.bounds_min.z);
+	into.bounds_max.x = max(into.bounds_max.x, from.bounds_max.x);
+	into.bounds_max.y = max(into.bounds_max.y, from.bounds_max.y);
+	into.bounds_max.z = max(into.bounds_max.z, from.bounds_max.z);
+
+	into.pending.append(from.pending);
+	triangle_batch().swap(from.pending);
+
+	parents[b] = a;
+
+	// If either was being written already, so is the whole merged component.
+	if (into.kept || from.kept || is_big_enough(into))
+		keep(a);
+
+	return a;
+}
+
+void component_filter_writer::add_triangle(size_t id, const triangle_batch& batch, size_t i)
+{
+	component& c = components[id];
+	const triangle& t = batch.triangles[i];
+
+	for (size_t j = 0; j < 3; j++)
+	{
+		const vertex_3& v = t.vertex[j];
+
+		if (0 == c.num_triangles && 0 == j)
+		{
+			c.bounds_min = v;
+			c.bounds_max = v;
+			continue;
+		}
+
+		c.bounds_min.x = min(c.bounds_min.x, v.x);
+		c.bounds_min.y = min(c.bounds_min.y, v.y);
+		c.bounds_min.z = min(c.bounds_min.z, v.z);
+		c.bounds_max.x = max(c.bounds_max.x, v.x);
+		c.bounds_max.y = max(c.bounds_max.y, v.y);
+		c.bounds_max.z = max(c.bounds_max.z, v.z);
+	}
+
+	c.num_triangles++;
+
+	if (c.kept)
+	{
+		output.push_back(batch, i);
+		return;
+	}
+
+	c.pending.push_back(batch, i);
+	num_deferred_triangles++;
+
+	if (is_big_enough(c))
+		keep(id);
+}
+
+void component_filter_writer::keep(size_t id)
+{
+	component& c = components[id];
+
+	c.kept = true;
+	output.append(c.pending);
+	num_deferred_triangles -= c.pending.size();
+	triangle_batch().swap(c.pending);
+}
+
+bool component_filter_writer::is_big_enough(const component& c) const
+{
+	if (c.num_triangles < settings.min_triangles)
+		return false;
+
+	const float extent = max(max(c.bounds_max.x - c.bounds_min.x, c.bounds_max.y - c.bounds_min.y), c.bounds_max.z - c.bounds_min.z);
+
+	return extent >= settings.min_extent;
+}
+
+void component_filter_writer::end_batch(void)
+{
+	const size_t none = static_cast<size_t>(-1);
+
+	// The components that this batch touched get new, dense ids.
+	vector<size_t> new_ids(components.size(), none);
+	vector<size_t> new_parents;
+	vector<component> new_components;
+
+	for (component_map::iterator i = current.begin(); i != current.end(); i++)
+	{
+		const size_t root = find(i->second);
+
+		if (none == new_ids[root])
+		{
+			new_ids[root] = new_components.size();
+			new_parents.push_back(new_components.size());
+			new_components.push_back(component());
+			new_components.back().num_triangles = components[root].num_triangles;
+			new_components.back().bounds_min = components[root].bounds_min;
+			new_components.back().bounds_max = components[root].bounds_max;
+			new_components.back().kept = components[root].kept;
+			new_components.back().pending.swap(components[root].pending);
+		}
+
+		i->second = new_ids[root];
+	}
+
+	// The rest are complete.
+	for (size_t id = 0; id < components.size(); id++)
+	{
+		if (parents[id] != id || none != new_ids[id] || components[id].kept)
+			continue;
+
+		num_dropped_components++;
+		num_dropped_triangles += components[id].num_triangles;
+		num_deferred_triangles -= components[id].pending.size();
+	}
+
+	parents.swap(new_parents);
+	components.swap(new_components);
+
+	previous.swap(current);
+	current.clear();
+}
+
+void component_filter_writer::release_deferred(void)
+{
+	while (num_deferred_triangles > settings.max_deferred_triangles && components.size() > 0)
+	{
+		size_t largest = 0;
+
+		for (size_t id = 1; id < components.size(); id++)
+			if (components[id].pending.size() > components[largest].pending.size())
+				largest = id;
+
+		keep(largest);
+	}
+}
+
+
+
+decimating_mesh_writer::decimating_mesh_writer(mesh_writer* const src_writer, const decimation_settings& src_settings)
+	: writer(src_writer), settings(src_settings), num_batches(0), num_input_triangles(0), num_output_triangles(0)
+{
+}
+
+decimating_mesh_writer::~decimating_mesh_writer(void)
+{
+	delete writer;
+}
+
+bool decimating_mesh_writer::open(const char* const file_name)
+{
+	window.clear();
+	num_batches = 0;
+	num_input_triangles = 0;
+	num_output_triangles = 0;
+
+	return writer->open(file_name);
+}
+
+bool decimating_mesh_writer::write(const triangle_batch& batch)
+{
+	window.append(batch);
+	num_batches++;
+
+	if (num_batches < settings.window_batches)
+		return true;
+
+	return flush();
+}
+
+bool decimating_mesh_writer::close(void)
+{
+	bool ok = flush();
+
+	cout << "Decimated " << num_input_triangles << " triangle(s) to " << num_output_triangles << endl;
+
+	return writer->close() && ok;
+}
+
+void decimating_mesh_writer::abandon(void)
+{
+	window.clear();
+	writer->abandon();
+}
+
+bool decimating_mesh_writer::flush(void)
+{
+	num_batches = 0;
+
+	if (0 == window.size())
+		return true;
+
+	num_input_triangles += window.size();
+	decimate_triangles(window, settings);
+	num_output_triangles += window.size();
+
+	const bool ok = writer->write(window);
+	window.clear();
+
+	return ok;
+}
+
+
+
+// The sum of the squared distances to a set of planes, as a symmetric 4x4 matrix:
+//
+//   q[0] q[1] q[2] q[3]
+//        q[4] q[5] q[6]
+//             q[7] q[8]
+//                  q[9]
+class quadric
+{
+public:
+	quadric(void)
+	{
+		for (size_t i = 0; i < 10; i++)
+			q[i] = 0;
+	}
+
+	// The plane is ax + by + cz + d = 0, with (a, b, c) of unit length.
+	void add_plane(double a, double b, double c, double d)
+	{
+		q[0] += a * a; q[1] += a * b; q[2] += a * c; q[3] += a * d;
+		q[4] += b * b; q[5] += b * c; q[6] += b * d;
+		q[7] += c * c; q[8] += c * d;
+		q[9] += d * d;
+	}
+
+	void add(const quadric& right)
+	{
+		for (size_t i = 0; i < 10; i++)
+			q[i] += right.q[i];
+	}
+
+	double error(double x, double y, double z) const
+	{
+		const double e =
+			q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x +
+			q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y +
+			q[7] * z * z + 2 * q[8] * z +
+			q[9];
+
+		// Rounding can take it a little below zero.
+		return (e > 0) ? e : 0;
+	}
+
+	// Finds the point of least error, unless the planes are too close to parallel to pin one down.
+	bool get_minimum(double& x, double& y, double& z) const
+	{
+		const double det =
+			q[0] * (q[4] * q[7] - q[5] * q[5]) -
+			q[1] * (q[1] * q[7] - q[5] * q[2]) +
+			q[2] * (q[1] * q[5] - q[4] * q[2]);
+
+		const double trace = q[0] + q[4] + q[7];
+
+		if (fabs(det) <= 1e-6 * trace * trace * trace)
+			return false;
+
+		// Cramer's rule on A p = -b.
+		const double bx = -q[3];
+		const double by = -q[6];
+		const double bz = -q[8];
+
+		x = (bx * (q[4] * q[7] - q[5] * q[5]) - q[1] * (by * q[7] - q[5] * bz) + q[2] * (by * q[5] - q[4] * bz)) / det;
+		y = (q[0] * (by * q[7] - q[5] * bz) - bx * (q[1] * q[7] - q[5] * q[2]) + q[2] * (q[1] * bz - by * q[2])) / det;
+		z = (q[0] * (q[4] * bz - by * q[5]) - q[1] * (q[1] * bz - by * q[2]) + bx * (q[1] * q[5] - q[4] * q[2])) / det;
+
+		return true;
+	}
+
+private:
+	double q[10];
+};
+
+class decimation_vertex
+{
+public:
+	decimation_vertex(void) : locked(false), removed(false), stamp(0) { }
+
+	vertex_3 position;
+	vertex_3 normal;
+	quadric q;
+	bool locked;
+	bool removed;
+
+	// Bumped whenever the vertex changes, which makes older collapses involving it stale.
+	size_t stamp;
+
+	vector<size_t> faces;
+};
+
+class decimation_face
+{
+public:
+	size_t v[3];
+	bool removed;
+};
+
+class edge_collapse
+{
+public:
+	double error;
+	size_t a, b;
+	size_t stamp_a, stamp_b;
+	vertex_3 position;
+
+	// priority_queue puts the greatest first, so this puts the least error first.
+	bool operator<(const edge_collapse& right) const { return error > right.error; }
+};
+
+// Unnormalized face normal, as if vertex moved were at position.
+static void get_face_normal(const vector<decimation_vertex>& vertices, const decimation_face& f, size_t moved, const vertex_3& position, double n[3])
+{
+	double p[3][3];
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		const vertex_3& v = (f.v[i] == moved) ? position : vertices[f.v[i]].position;
+		p[i][0] = v.x;
+		p[i][1] = v.y;
+		p[i][2] = v.z;
+	}
+
+	const double e0[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+	const double e1[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+
+	n[0] = e0[1] * e1[2] - e0[2] * e1[1];
+	n[1] = e0[2] * e1[0] - e0[0] * e1[2];
+	n[2] = e0[0] * e1[1] - e0[1] * e1[0];
+}
+
+// Works out where the vertices of edge (a, b) would merge to, and the error of doing so.
+static edge_collapse get_edge_collapse(const vector<decimation_vertex>& vertices, size_t a, size_t b)
+{
+	const decimation_vertex& va = vertices[a];
+	const decimation_vertex& vb = vertices[b];
+
+	quadric q = va.q;
+	q.add(vb.q);
+
+	edge_collapse c;
+	c.a = a;
+	c.b = b;
+	c.stamp_a = va.stamp;
+	c.stamp_b = vb.stamp;
+
+	if (va.locked || vb.locked)
+	{
+		c.position = va.locked ? va.position : vb.position;
+		c.error = q.error(c.position.x, c.position.y, c.position.z);
+		return c;
+	}
+
+	const double mid[3] = { 0.5 * (va.position.x + vb.position.x), 0.5 * (va.position.y + vb.position.y), 0.5 * (va.position.z + vb.position.z) };
+	const double dx = vb.position.x - va.position.x;
+	const double dy = vb.position.y - va.position.y;
+	const double dz = vb.position.z - va.position.z;
+	const double length_squared = dx * dx + dy * dy + dz * dz;
+
+	double x = 0, y = 0, z = 0;
+
+	// Use the optimal point unless it lies well away from the edge, which happens when the planes are nearly parallel.
+	if (q.get_minimum(x, y, z) && (x - mid[0]) * (x - mid[0]) + (y - mid[1]) * (y - mid[1]) + (z - mid[2]) * (z - mid[2]) <= length_squared)
+	{
+		c.position = vertex_3(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z), 0);
+		c.error = q.error(x, y, z);
+		return c;
+	}
+
+	// Otherwise take the best of the endpoints and the midpoint.
+	const vertex_3 candidates[3] = { va.position, vb.position, vertex_3(static_cast<float>(mid[0]), static_cast<float>(mid[1]), static_cast<float>(mid[2]), 0) };
+
+	c.error = -1;
+
+	for (size_t i = 0; i < 3; i++)
+	{
+		const double e = q.error(candidates[i].x, candidates[i].y, candidates[i].z);
+
+		if (c.error < 0 || e < c.error)
+		{
+			c.error = e;
+			c.position = candidates[i];
+		}
+	}
+
+	return c;
+}
+
+// Lists the live vertices that share a face with vertex v.
+static void get_neighbours(const vector<decimation_vertex>& vertices, const vector<decimation_face>& faces, size_t v, vector<size_t>& neighbours)
+{
+	neighbours.clear();
+
+	for (size_t i = 0; i < vertices[v].faces.size(); i++)
+	{
+		const decimation_face& f = faces[vertices[v].faces[i]];
+
+		if (f.removed)
+			continue;
+
+		for (size_t j = 0; j < 3; j++)
+			if (f.v[j] != v && find(neighbours.begin(), neighbours.end(), f.v[j]) == neighbours.end())
+				neighbours.push_back(f.v[j]);
+	}
+}
+
+// A collapse must not pinch the surface (the ends may share only the two vertices
+// opposite the edge), nor turn any remaining face over.
+static bool is_collapse_valid(const vector<decimation_vertex>& vertices, const vector<decimation_face>& faces, const edge_collapse& c, vector<size_t>& scratch_a, vector<size_t>& scratch_b)
+{
+	get_neighbours(vertices, faces, c.a, scratch_a);
+	get_neighbours(vertices, faces, c.b, scratch_b);
+
+	size_t num_shared = 0;
+
+	for (size_t i = 0; i < scratch_a.size(); i++)
+		if (find(scratch_b.begin(), scratch_b.end(), scratch_a[i]) != scratch_b.end())
+			num_shared++;
+
+	if (num_shared > 2)
+		return false;
+
+	// Nor may the ends both have a face on the same opposite edge, which would leave two faces on the same three vertices.
+	const vector<size_t>& faces_a = vertices[c.a].faces;
+	const vector<size_t>& faces_b = vertices[c.b].faces;
+
+	for (size_t i = 0; i < faces_a.size(); i++)
+	{
+		const decimation_face& fa = faces[faces_a[i]];
+
+		if (fa.removed || fa.v[0] == c.b || fa.v[1] == c.b || fa.v[2] == c.b)
+			continue;
+
+		for (size_t j = 0; j < faces_b.size(); j++)
+		{
+			const decimation_face& fb = faces[faces_b[j]];
+
+			if (fb.removed || fb.v[0] == c.a || fb.v[1] == c.a || fb.v[2] == c.a)
+				continue;
+
+			size_t num_common = 0;
+
+			for (size_t k = 0; k < 3; k++)
+				if (fa.v[k] != c.a && (fb.v[0] == fa.v[k] || fb.v[1] == fa.v[k] || fb.v[2] == fa.v[k]))
+					num_common++;
+
+			if (2 == num_common)
+				return false;
+		}
+	}
+
+	// Nor may it pull a face flat onto the open edge, where the next window could do the same from the other side.
+	const size_t keep = vertices[c.b].locked ? c.b : c.a;
+	const size_t gone = (keep == c.a) ? c.b : c.a;
+
+	if (vertices[keep].locked)
+	{
+		const vector<size_t>& vf = vertices[gone].faces;
+
+		for (size_t i = 0; i < vf.size(); i++)
+		{
+			const decimation_face& f = faces[vf[i]];
+
+			if (f.removed || f.v[0] == keep || f.v[1] == keep || f.v[2] == keep)
+				continue;
+
+			size_t num_locked = 0;
+
+			for (size_t j = 0; j < 3; j++)
+				if (f.v[j] != gone && vertices[f.v[j]].locked)
+					num_locked++;
+
+			if (2 == num_locked)
+				return false;
+		}
+	}
+
+	const size_t ends[2] = { c.a, c.b };
+
+	for (size_t e = 0; e < 2; e++)
+	{
+		const vector<size_t>& vf = vertices[ends[e]].faces;
+
+		for (size_t i = 0; i < vf.size(); i++)
+		{
+			const decimation_face& f = faces[vf[i]];
+
+			if (f.removed)
+				continue;
+
+			// Faces on the edge itself go away.
+			if ((f.v[0] == c.a || f.v[1] == c.a || f.v[2] == c.a) && (f.v[0] == c.b || f.v[1] == c.b || f.v[2] == c.b))
+				continue;
+
+			double before[3], after[3];
+			get_face_normal(vertices, f, ends[e], vertices[ends[e]].position, before);
+			get_face_normal(vertices, f, ends[e], c.position, after);
+
+			if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+size_t decimate_triangles(triangle_batch& batch, const decimation_settings& settings)
+{
+	vector<triangle>& triangles = batch.triangles;
+	const bool has_normals = batch.has_normals();
+
+	typedef unordered_map<vertex_3, size_t, vertex_position_hash, vertex_position_equal> index_map;
+
+	vector<decimation_vertex> vertices;
+	vector<decimation_face> faces;
+	index_map indices;
+
+	// Weld the triangles into an indexed mesh.
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		decimation_face f;
+		f.removed = false;
+
+		for (size_t j = 0; j < 3; j++)
+		{
+			index_map::const_iterator v = indices.find(triangles[i].vertex[j]);
+
+			if (v != indices.end())
+			{
+				f.v[j] = v->second;
+				continue;
+			}
+
+			f.v[j] = vertices.size();
+			indices[triangles[i].vertex[j]] = f.v[j];
+
+			vertices.push_back(decimation_vertex());
+			vertices.back().position = triangles[i].vertex[j];
+			vertices.back().normal = batch.get_normal(i, j);
+		}
+
+		// Marching cubes makes a few faces with repeated vertices; they cover no area.
+		if (f.v[0] == f.v[1] || f.v[1] == f.v[2] || f.v[2] == f.v[0])
+			continue;
+
+		faces.push_back(f);
+	}
+
+	// Every vertex starts out with the quadric of the planes of its faces.
+	unordered_map<unsigned long long, size_t> edge_use;
+
+	for (size_t i = 0; i < faces.size(); i++)
+	{
+		const decimation_face& f = faces[i];
+
+		double n[3];
+		get_face_normal(vertices, f, f.v[0], vertices[f.v[0]].position, n);
+
+		const double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+		for (size_t j = 0; j < 3; j++)
+		{
+			decimation_vertex& v = vertices[f.v[j]];
+			v.faces.push_back(i);
+
+			if (length > 0)
+			{
+				const double a = n[0] / length, b = n[1] / length, c = n[2] / length;
+				v.q.add_plane(a, b, c, -(a * v.position.x + b * v.position.y + c * v.position.z));
+			}
+
+			const unsigned long long lo = min(f.v[j], f.v[(j + 1) % 3]);
+			const unsigned long long hi = max(f.v[j], f.v[(j + 1) % 3]);
+			edge_use[(hi << 32) | lo]++;
+		}
+	}
+
+	// Open edges are where the window meets the next one, or the sides of the grid.
+	// Edges with more than two faces are left alone too.
+	for (unordered_map<unsigned long long, size_t>::const_iterator i = edge_use.begin(); i != edge_use.end(); i++)
+	{
+		if (2 == i->second)
+			continue;
+
+		vertices[i->first & 0xffffffffull].locked = true;
+		vertices[i->first >> 32].locked = true;
+	}
+
+	priority_queue<edge_collapse> collapses;
+
+	for (unordered_map<unsigned long long, size_t>::const_iterator i = edge_use.begin(); i != edge_use.end(); i++)
+	{
+		const size_t a = static_cast<size_t>(i->first & 0xffffffffull);
+		const size_t b = static_cast<size_t>(i->first >> 32);
+
+		if (!vertices[a].locked || !vertices[b].locked)
+			collapses.push(get_edge_collapse(vertices, a, b));
+	}
+
+	const double max_error = static_cast<double>(settings.max_error) * settings.max_error;
+	const size_t target_faces = static_cast<size_t>(settings.target_ratio * faces.size());
+
+	size_t num_faces = faces.size();
+	size_t num_collapses = 0;
+	vector<size_t> scratch_a, scratch_b;
+
+	while (!collapses.empty() && num_faces > target_faces)
+	{
+		const edge_collapse c = collapses.top();
+		collapses.pop();
+
+		if (c.error > max_error)
+			break;
+
+		if (vertices[c.a].removed || vertices[c.b].removed || vertices[c.a].stamp != c.stamp_a || vertices[c.b].stamp != c.stamp_b)
+			continue;
+
+		if (!is_collapse_valid(vertices, faces, c, scratch_a, scratch_b))
+			continue;
+
+		// Keep the locked end, if there is one, as is_collapse_valid() assumes.
+		const size_t keep = vertices[c.b].locked ? c.b : c.a;
+		const size_t gone = (keep == c.a) ? c.b : c.a;
+
+		decimation_vertex& vk = vertices[keep];
+		decimation_vertex& vg = vertices[gone];
+
+		for (size_t i = 0; i < vg.faces.size(); i++)
+		{
+			decimation_face& f = faces[vg.faces[i]];
+
+			if (f.removed)
+				continue;
+
+			if (f.v[0] == keep || f.v[1] == keep || f.v[2] == keep)
+			{
+				f.removed = true;
+				num_faces--;
+				continue;
+			}
+
+			for (size_t j = 0; j < 3; j++)
+				if (f.v[j] == gone)
+					f.v[j] = keep;
+
+			vk.faces.push_back(vg.faces[i]);
+		}
+
+		vk.q.add(vg.q);
+
+		if (!vk.locked)
+		{
+			vk.position = c.position;
+			vk.normal.x += vg.normal.x;
+			vk.normal.y += vg.normal.y;
+			vk.normal.z += vg.normal.z;
+			vk.normal.normalize();
+		}
+
+		vk.stamp++;
+		vg.removed = true;
+		vector<size_t>().swap(vg.faces);
+
+		// Drop the dead faces from the survivor's list.
+		size_t live = 0;
+
+		for (size_t i = 0; i < vk.faces.size(); i++)
+			if (!faces[vk.faces[i]].removed)
+				vk.faces[live++] = vk.faces[i];
+
+		vk.faces.resize(live);
+
+		get_neighbours(vertices, faces, keep, scratch_a);
+
+		for (size_t i = 0; i < scratch_a.size(); i++)
+			if (!vk.locked || !vertices[scratch_a[i]].locked)
+				collapses.push(get_edge_collapse(vertices, keep, scratch_a[i]));
+
+		num_collapses++;
+	}
+
+	batch.clear();
+
+	for (size_t i = 0; i < faces.size(); i++)
+	{
+		if (faces[i].removed)
+			continue;
+
+		triangle t;
+
+		for (size_t j = 0; j < 3; j++)
+		{
+			t.vertex[j] = vertices[faces[i].v[j]].position;
+
+			if (has_normals)
+				batch.normals.push_back(vertices[faces[i].v[j]].normal);
+		}
+
+		triangles.push_back(t);
+	}
+
+	return num_collapses;
+}
@@ -0,0 +1,157 @@
+#ifndef MESH_FILTER_H
+#define MESH_FILTER_H
+
+#include "mesh_writer.h"
+
+#include <unordered_map>
+using std::unordered_map;
+
+#include <vector>
+using std::vector;
+
+
+// Limits below which a connected piece of surface is dropped.
+class component_filter_settings
+{
+public:
+	component_filter_settings(void) : min_triangles(0), min_extent(0.0f), max_deferred_triangles(1048576) { }
+
+	bool is_enabled(void) const { return min_triangles > 0 || min_extent > 0.0f; }
+
+	// A component is kept if it has at least min_triangles triangles,
+	// and its bounding box is at least min_extent across along some axis.
+	size_t min_triangles;
+	float min_extent;
+
+	// The most triangles that are held back while their component might still be dropped.
+	// Beyond this, the largest undecided components are written out as they are.
+	size_t max_deferred_triangles;
+};
+
+// Drops small disconnected pieces of surface on their way to another mesh writer.
+// Each batch is one slice pair from marching cubes, so a component can only grow into the
+// next batch through the vertices of the current one. Components are tracked by union-find,
+// keyed by vertex position over the current and previous batches, just like vertex_welder.
+// A component's triangles are held back until it is big enough, at which point they are passed
+// on together with everything it gains later, or until a batch adds nothing to it, at which
+// point it is complete and can be dropped.
+class component_filter_writer : public mesh_writer
+{
+public:
+	// Takes ownership of src_writer.
+	component_filter_writer(mesh_writer* const src_writer, const component_filter_settings& src_settings);
+	~component_filter_writer(void);
+
+	bool open(const char* const file_name);
+	bool write(const triangle_batch& batch);
+	bool close(void);
+	void abandon(void);
+
+private:
+	component_filter_writer(const component_filter_writer&);
+	component_filter_writer& operator=(const component_filter_writer&);
+
+	class component
+	{
+	public:
+		component(void) : num_triangles(0), kept(false) { }
+
+		size_t num_triangles;
+		vertex_3 bounds_min;
+		vertex_3 bounds_max;
+		bool kept;
+		triangle_batch pending;
+	};
+
+	size_t find(size_t id);
+	size_t merge(size_t a, size_t b);
+
+	// Adds triangle i of the batch, and its normals, to component id.
+	void add_triangle(size_t id, const triangle_batch& batch, size_t i);
+
+	void keep(size_t id);
+	bool is_big_enough(const component& c) const;
+
+	// Drops the components that the batch did not touch, and renumbers the rest.
+	void end_batch(void);
+
+	// Keeps the largest undecided components until few enough triangles are held back.
+	void release_deferred(void);
+
+	typedef unordered_map<vertex_3, size_t, vertex_position_hash, vertex_position_equal> component_map;
+
+	mesh_writer* writer;
+	component_filter_settings settings;
+
+	vector<size_t> parents;
+	vector<component> components;
+	component_map previous;
+	component_map current;
+
+	triangle_batch output;
+	size_t num_deferred_triangles;
+	size_t num_dropped_components;
+	size_t num_dropped_triangles;
+};
+
+
+// Limits on how far a mesh is simplified.
+class decimation_settings
+{
+public:
+	decimation_settings(void) : max_error(0.0f), target_ratio(0.0f), window_batches(16) { }
+
+	bool is_enabled(void) const { return max_error > 0.0f; }
+
+	// No edge is collapsed if that would move the surface further than max_error
+	// (the square root of the quadric error), so this bounds the error.
+	float max_error;
+
+	// Collapsing stops once a window is down to this fraction of its triangles, if that comes first.
+	float target_ratio;
+
+	// How many batches (slice pairs) are simplified together. Bigger windows have
+	// proportionally less locked seam, so they simplify further, but hold more triangles.
+	size_t window_batches;
+};
+
+// Simplifies a mesh on its way to another mesh writer, by quadric error metric edge collapse.
+// Batches are gathered into a sliding window, which is simplified and passed on as a single batch
+// once it is full. Every vertex on an open edge is locked, which keeps the seam that the window
+// shares with the next one exactly where marching cubes put it, as well as the outline where the
+// surface meets the sides of the grid.
+class decimating_mesh_writer : public mesh_writer
+{
+public:
+	// Takes ownership of src_writer.
+	decimating_mesh_writer(mesh_writer* const src_writer, const decimation_settings& src_settings);
+	~decimating_mesh_writer(void);
+
+	bool open(const char* const file_name);
+	bool write(const triangle_batch& batch);
+	bool close(void);
+	void abandon(void);
+
+private:
+	decimating_mesh_writer(const decimating_mesh_writer&);
+	decimating_mesh_writer& operator=(const decimating_mesh_writer&);
+
+	// Simplifies the window, and hands the result on.
+	bool flush(void);
+
+	mesh_writer* writer;
+	decimation_settings settings;
+
+	triangle_batch window;
+	size_t num_batches;
+	size_t num_input_triangles;
+	size_t num_output_triangles;
+};
+
+// Simplifies the triangles in place. Vertices are welded by position, and vertices on open edges
+// are never moved. Vertex normals, if the batch has them, are merged along with their vertices.
+// Returns the number of edges collapsed.
+size_t decimate_triangles(triangle_batch& batch, const decimation_settings& settings);
+
+
+#endif
@@ -0,0 +1,733 @@
+#include "mesh_writer.h"
+#include "worker_pool.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+using namespace std;
+
+
+// Appends the whole of the file named from_name to out, then deletes it.
+static bool append_and_remove_file(ofstream& out, const string& from_name)
+{
+	ifstream in(from_name.c_str(), ios_base::binary);
+
+	if (in.fail())
+		return false;
+
+	vector<char> buffer(1048576);
+
+	while (in)
+	{
+		in.read(&buffer[0], buffer.size());
+
+		if (in.gcount() > 0)
+			out.write(&buffer[0], in.gcount());
+	}
+
+	in.close();
+	remove(from_name.c_str());
+
+	return !out.fail();
+}
+
+// Overwrites a zero-padded decimal count that was reserved in a text header.
+static void patch_decimal_count(ofstream& out, size_t offset, size_t count, size_t width)
+{
+	ostringstream text;
+	text << setw(width) << setfill('0') << count;
+
+	out.seekp(offset);
+	out.write(text.str().c_str(), width);
+}
+
+
+void encode_stereo_lithography_record(const triangle& t, char* const record)
+{
+	// Get face normal.
+	// This is done by hand rather than with vertex_3::operator-() and vertex_3::cross(),
+	// because those return a reference to a static temporary, and this function is called
+	// from several threads at once.
+	const float ax = t.vertex[1].x - t.vertex[0].x;
+	const float ay = t.vertex[1].y - t.vertex[0].y;
+	const float az = t.vertex[1].z - t.vertex[0].z;
+	const float bx = t.vertex[2].x - t.vertex[0].x;
+	const float by = t.vertex[2].y - t.vertex[0].y;
+	const float bz = t.vertex[2].z - t.vertex[0].z;
+
+	vertex_3 normal(ay * bz - az * by, az * bx - ax * bz, ax * by - ay * bx, 0);
+	normal.normalize();
+
+	const float data[12] =
+	{
+		normal.x, normal.y, normal.z,
+		t.vertex[0].x, t.vertex[0].y, t.vertex[0].z,
+		t.vertex[1].x, t.vertex[1].y, t.vertex[1].z,
+		t.vertex[2].x, t.vertex[2].y, t.vertex[2].z
+	};
+
+	// The record is only 2-byte aligned in the file, so copy rather than cast.
+	memcpy(record, data, sizeof(data));
+
+	const short unsigned int attribute = 0;
+	memcpy(record + sizeof(data), &attribute, sizeof(attribute));
+}
+
+stl_mesh_writer::~stl_mesh_writer(void)
+{
+	delete workers;
+}
+
+bool stl_mesh_writer::open(const char* const file_name)
+{
+	// The blank header is already zeroed, since the file is freshly sized.
+	if (false == out.create(file_name, stereo_lithography_header_size))
+		return false;
+
+	name = file_name;
+	num_triangles = 0;
+
+	return true;
+}
+
+bool stl_mesh_writer::write(const triangle_batch& batch)
+{
+	const vector<triangle>& triangles = batch.triangles;
+
+	if (0 == triangles.size())
+		return true;
+
+	if (false == out.is_open())
+		return false;
+
+	const size_t needed = stereo_lithography_header_size + stereo_lithography_record_size * (num_triangles + triangles.size());
+
+	// Grow by at least doubling, so that the file is only remapped a handful of times.
+	if (needed > out.size())
+	{
+		size_t file_size = 2 * out.size();
+
+		if (file_size < needed)
+			file_size = needed;
+
+		if (false == out.resize(file_size))
+			return false;
+	}
+
+	char* const records = out.data() + stereo_lithography_header_size + stereo_lithography_record_size * num_triangles;
+
+	// Don't bother waking threads for small batches.
+	const size_t min_triangles_per_thread = 16384;
+
+	size_t num_chunks = triangles.size() / min_triangles_per_thread;
+
+	if (num_chunks < 2)
+	{
+		for (size_t i = 0; i < triangles.size(); i++)
+			encode_stereo_lithography_record(triangles[i], records + i * stereo_lithography_record_size);
+	}
+	else
+	{
+		if (0 == workers)
+			workers = new worker_pool;
+
+		if (num_chunks > workers->get_num_threads())
+			num_chunks = workers->get_num_threads();
+
+		// Each thread gets at most one chunk; any threads beyond num_chunks get an empty range.
+		auto encode_chunks = [&triangles, records, num_chunks](size_t begin, size_t end)
+		{
+			for (size_t chunk = begin; chunk < end; chunk++)
+			{
+				const size_t first = triangles.size() * chunk / num_chunks;
+				const size_t last = triangles.size() * (chunk + 1) / num_chunks;
+
+				for (size_t i = first; i < last; i++)
+					encode_stereo_lithography_record(triangles[i], records + i * stereo_lithography_record_size);
+			}
+		};
+
+		workers->run(num_chunks, encode_chunks);
+	}
+
+	num_triangles += triangles.size();
+
+	return true;
+}
+
+bool stl_mesh_writer::close(void)
+{
+	cout << "Triangle count: " << num_triangles << endl;
+
+	if (false == out.is_open())
+		return false;
+
+	if (num_triangles > 0xffffffff)
+	{
+		cout << "Too many triangles for a binary Stereo Lithography file" << endl;
+		out.close();
+		return false;
+	}
+
+	// Don't leave empty meshes behind.
+	if (0 == num_triangles)
+	{
+		out.close();
+		remove(name.c_str());
+		return true;
+	}
+
+	// Write number of triangles.
+	const unsigned int count = static_cast<unsigned int>(num_triangles); // Must be 4-byte unsigned int.
+	memcpy(out.data() + 80, &count, sizeof(unsigned int));
+
+	// Trim off the room that was grown but not used.
+	const bool ok = out.resize(stereo_lithography_header_size + stereo_lithography_record_size * num_triangles);
+	out.close();
+
+	if (ok)
+		cout << "Wrote " << stereo_lithography_record_size * num_triangles / 1048576.0f << " MB of data to binary Stereo Lithography file: " << name << endl;
+
+	return ok;
+}
+
+void stl_mesh_writer::abandon(void)
+{
+	if (out.is_open())
+	{
+		out.close();
+		remove(name.c_str());
+	}
+}
+
+
+
+background_mesh_writer::background_mesh_writer(size_t queue_depth, size_t src_batch_reserve, bool src_reserve_normals)
+	: jobs(queue_depth), batch_reserve(src_batch_reserve), reserve_normals(src_reserve_normals), abandoning(false), ok(true), finished(false)
+{
+	// The queue's slots, the next job and the job the I/O thread holds are all the
+	// buffers that will ever go round, so give each of them room now.
+	jobs.prepare_slots([this](job& j) { j.batch.reserve(batch_reserve, reserve_normals); });
+	next.batch.reserve(batch_reserve, reserve_normals);
+
+	io_thread = thread(&background_mesh_writer::run, this);
+}
+
+void background_mesh_writer::open(size_t stream, mesh_writer* writer, const string& file_name)
+{
+	next.type = open_job;
+	next.stream = stream;
+	next.writer = writer;
+	next.file_name = file_name;
+
+	jobs.push(next);
+}
+
+void background_mesh_writer::write(size_t stream, triangle_batch& batch)
+{
+	next.type = write_job;
+	next.stream = stream;
+	next.writer = 0;
+	next.batch.swap(batch);
+
+	jobs.push(next);
+}
+
+void background_mesh_writer::close(size_t stream)
+{
+	next.type = close_job;
+	next.stream = stream;
+	next.writer = 0;
+
+	jobs.push(next);
+}
+
+bool background_mesh_writer::finish(void)
+{
+	if (!finished)
+	{
+		jobs.close();
+		io_thread.join();
+		finished = true;
+
+		// Close anything that was left open.
+		for (map<size_t, mesh_writer*>::iterator i = writers.begin(); i != writers.end(); i++)
+		{
+			if (false == i->second->close())
+				ok = false;
+
+			delete i->second;
+		}
+
+		writers.clear();
+	}
+
+	return ok;
+}
+
+void background_mesh_writer::abandon(void)
+{
+	if (finished)
+		return;
+
+	// The I/O thread drops whatever is still queued once it sees this.
+	abandoning = true;
+
+	jobs.close();
+	io_thread.join();
+	finished = true;
+
+	for (map<size_t, mesh_writer*>::iterator i = writers.begin(); i != writers.end(); i++)
+	{
+		i->second->abandon();
+		delete i->second;
+	}
+
+	writers.clear();
+	ok = false;
+}
+
+void background_mesh_writer::run(void)
+{
+	job j;
+	j.batch.reserve(batch_reserve, reserve_normals);
+
+	// Whatever j holds goes back into the queue on the next pop, so empty it first.
+	for (; jobs.pop(j); j.batch.clear())
+	{
+		if (abandoning)
+		{
+			// Only the writers that were handed over still need deleting; abandon() sees to the open ones.
+			if (open_job == j.type)
+				delete j.writer;
+
+			continue;
+		}
+
+		if (open_job == j.type)
+		{
+			// Replace any writer that is still open on this stream.
+			if (writers.count(j.stream))
+			{
+				writers[j.stream]->close();
+				delete writers[j.stream];
+			}
+
+			writers[j.stream] = j.writer;
+
+			if (false == j.writer->open(j.file_name.c_str()))
+			{
+				cout << "Couldn't open mesh file: " << j.file_name << endl;
+				ok = false;
+			}
+		}
+		else
+		{
+			map<size_t, mesh_writer*>::iterator i = writers.find(j.stream);
+
+			if (i == writers.end())
+				continue;
+
+			if (write_job == j.type)
+			{
+				if (false == i->second->write(j.batch))
+					ok = false;
+			}
+			else
+			{
+				if (false == i->second->close())
+					ok = false;
+
+				delete i->second;
+				writers.erase(i);
+			}
+		}
+	}
+}
+
+
+
+
+size_t vertex_position_hash::operator()(const vertex_3& v) const
+{
+	unsigned int bits[3];
+	memcpy(&bits[0], &v.x, sizeof(float));
+	memcpy(&bits[1], &v.y, sizeof(float));
+	memcpy(&bits[2], &v.z, sizeof(float));
+
+	size_t h = bits[0];
+	h = h * 0x9E3779B1u ^ bits[1];
+	h = h * 0x9E3779B1u ^ bits[2];
+
+	return h;
+}
+
+size_t vertex_welder::weld(const vertex_3& v, bool& is_new)
+{
+	index_map::const_iterator i = previous.find(v);
+
+	if (i != previous.end())
+	{
+		is_new = false;
+		return i->second;
+	}
+
+	i = current.find(v);
+
+	if (i != current.end())
+	{
+		is_new = false;
+		return i->second;
+	}
+
+	is_new = true;
+	current[v] = num_vertices;
+
+	return num_vertices++;
+}
+
+void vertex_welder::next_batch(void)
+{
+	previous.swap(current);
+	current.clear();
+}
+
+
+
+// Width of the zero-padded element counts reserved in the PLY header; enough for any 64-bit count.
+static const size_t ply_count_width = 20;
+
+bool ply_mesh_writer::open(const char* const file_name)
+{
+	name = file_name;
+	faces_name = name + ".faces.tmp";
+	num_triangles = 0;
+	welder = vertex_welder();
+
+	out.open(file_name, ios_base::binary);
+	faces_out.open(faces_name.c_str(), ios_base::binary);
+
+	if (out.fail() || faces_out.fail())
+		return false;
+
+	out << "ply\n";
+	out << "format binary_little_endian 1.0\n";
+	out << "element vertex ";
+	vertex_count_offset = static_cast<size_t>(out.tellp());
+	out << string(ply_count_width, '0') << "\n";
+	out << "property float x\n";
+	out << "property float y\n";
+	out << "property float z\n";
+	out << "property float nx\n";
+	out << "property float ny\n";
+	out << "property float nz\n";
+	out << "element face ";
+	face_count_offset = static_cast<size_t>(out.tellp());
+	out << string(ply_count_width, '0') << "\n";
+	out << "property list uchar int vertex_indices\n";
+	out << "end_header\n";
+
+	return !out.fail();
+}
+
+bool ply_mesh_writer::write(const triangle_batch& batch)
+{
+	const vector<triangle>& triangles = batch.triangles;
+
+	if (0 == triangles.size())
+		return true;
+
+	vertex_buffer.clear();
+	face_buffer.resize(triangles.size() * (1 + 3 * sizeof(int)));
+
+	char* fp = &face_buffer[0];
+
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		*fp++ = 3;
+
+		for (size_t j = 0; j < 3; j++)
+		{
+			bool is_new = false;
+			const int index = static_cast<int>(welder.weld(triangles[i].vertex[j], is_new));
+
+			if (is_new)
+			{
+				const vertex_3& v = triangles[i].vertex[j];
+				const vertex_3 n = batch.get_normal(i, j);
+				const float record[6] = { v.x, v.y, v.z, n.x, n.y, n.z };
+				const char* cp = reinterpret_cast<const char*>(record);
+				vertex_buffer.insert(vertex_buffer.end(), cp, cp + sizeof(record));
+			}
+
+			memcpy(fp, &index, sizeof(int));
+			fp += sizeof(int);
+		}
+	}
+
+	welder.next_batch();
+	num_triangles += triangles.size();
+
+	if (vertex_buffer.size() > 0)
+		out.write(&vertex_buffer[0], vertex_buffer.size());
+
+	faces_out.write(&face_buffer[0], face_buffer.size());
+
+	return !out.fail() && !faces_out.fail();
+}
+
+bool ply_mesh_writer::close(void)
+{
+	faces_out.close();
+
+	bool ok = append_and_remove_file(out, faces_name);
+
+	patch_decimal_count(out, vertex_count_offset, welder.size(), ply_count_width);
+	patch_decimal_count(out, face_count_offset, num_triangles, ply_count_width);
+
+	ok = ok && !out.fail();
+	out.close();
+
+	cout << "Vertex count: " << welder.size() << ", triangle count: " << num_triangles << endl;
+
+	if (0 == num_triangles)
+	{
+		remove(name.c_str());
+		return ok;
+	}
+
+	cout << "Wrote indexed binary PLY file: " << name << endl;
+
+	return ok;
+}
+
+void ply_mesh_writer::abandon(void)
+{
+	if (out.is_open())
+	{
+		out.close();
+		remove(name.c_str());
+	}
+
+	if (faces_out.is_open())
+	{
+		faces_out.close();
+		remove(faces_name.c_str());
+	}
+}
+
+
+
+compact_mesh_writer::compact_mesh_writer(const vertex_3& src_bounds_min, const vertex_3& src_bounds_max)
+	: bounds_min(src_bounds_min), bounds_max(src_bounds_max), num_triangles(0), previous_index(0)
+{
+}
+
+// Offsets of the vertex and triangle counts in the .jcm header.
+static const size_t compact_counts_offset = 4 + 6 * sizeof(float);
+
+bool compact_mesh_writer::open(const char* const file_name)
+{
+	name = file_name;
+	indices_name = name + ".indices.tmp";
+	num_triangles = 0;
+	previous_index = 0;
+	welder = vertex_welder();
+
+	out.open(file_name, ios_base::binary);
+	indices_out.open(indices_name.c_str(), ios_base::binary);
+
+	if (out.fail() || indices_out.fail())
+		return false;
+
+	const float bounds[6] = { bounds_min.x, bounds_min.y, bounds_min.z, bounds_max.x, bounds_max.y, bounds_max.z };
+	const unsigned long long counts[2] = { 0, 0 };
+
+	out.write("JCM2", 4);
+	out.write(reinterpret_cast<const char*>(bounds), sizeof(bounds));
+	out.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+
+	return !out.fail();
+}
+
+// Maps v from [min_value, max_value] onto 0..65535.
+static short unsigned int quantize(float v, float min_value, float max_value)
+{
+	if (max_value <= min_value)
+		return 0;
+
+	float q = (v - min_value) / (max_value - min_value) * 65535.0f + 0.5f;
+
+	if (q < 0.0f)
+		q = 0.0f;
+	else if (q > 65535.0f)
+		q = 65535.0f;
+
+	return static_cast<short unsigned int>(q);
+}
+
+// Maps a unit normal onto the octahedron |x| + |y| + |z| = 1, unfolds the lower half over
+// the upper half's corners, and stores the resulting square coordinates in a byte each.
+static void encode_octahedral_normal(const vertex_3& n, signed char* const out)
+{
+	const float sum = fabs(n.x) + fabs(n.y) + fabs(n.z);
+
+	float u = 0.0f;
+	float v = 0.0f;
+
+	if (sum > 0.0f)
+	{
+		u = n.x / sum;
+		v = n.y / sum;
+
+		if (n.z < 0.0f)
+		{
+			const float folded_u = (1.0f - fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+			const float folded_v = (1.0f - fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+
+			u = folded_u;
+			v = folded_v;
+		}
+	}
+
+	out[0] = static_cast<signed char>(floor(u * 127.0f + 0.5f));
+	out[1] = static_cast<signed char>(floor(v * 127.0f + 0.5f));
+}
+
+bool compact_mesh_writer::write(const triangle_batch& batch)
+{
+	const vector<triangle>& triangles = batch.triangles;
+
+	if (0 == triangles.size())
+		return true;
+
+	vertex_buffer.clear();
+	index_buffer.clear();
+
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		for (size_t j = 0; j < 3; j++)
+		{
+			const vertex_3& v = triangles[i].vertex[j];
+
+			bool is_new = false;
+			const size_t index = welder.weld(v, is_new);
+
+			if (is_new)
+			{
+				const short unsigned int q[3] =
+				{
+					quantize(v.x, bounds_min.x, bounds_max.x),
+					quantize(v.y, bounds_min.y, bounds_max.y),
+					quantize(v.z, bounds_min.z, bounds_max.z)
+				};
+
+				signed char octahedral[2];
+				encode_octahedral_normal(batch.get_normal(i, j), octahedral);
+
+				const char* cp = reinterpret_cast<const char*>(q);
+				vertex_buffer.insert(vertex_buffer.end(), cp, cp + sizeof(q));
+				vertex_buffer.insert(vertex_buffer.end(), reinterpret_cast<const char*>(octahedral), reinterpret_cast<const char*>(octahedral) + sizeof(octahedral));
+			}
+
+			// Zigzag-encode the difference from the previous index, so that small
+			// steps either way take few bits, then store it 7 bits at a time.
+			const long long delta = static_cast<long long>(index) - static_cast<long long>(previous_index);
+			unsigned long long zigzag = (static_cast<unsigned long long>(delta) << 1) ^ static_cast<unsigned long long>(delta >> 63);
+
+			while (zigzag >= 0x80)
+			{
+				index_buffer.push_back(static_cast<char>((zigzag & 0x7f) | 0x80));
+				zigzag >>= 7;
+			}
+
+			index_buffer.push_back(static_cast<char>(zigzag));
+
+			previous_index = index;
+		}
+	}
+
+	welder.next_batch();
+	num_triangles += triangles.size();
+
+	if (vertex_buffer.size() > 0)
+		out.write(&vertex_buffer[0], vertex_buffer.size());
+
+	indices_out.write(&index_buffer[0], index_buffer.size());
+
+	return !out.fail() && !indices_out.fail();
+}
+
+bool compact_mesh_writer::close(void)
+{
+	indices_out.close();
+
+	bool ok = append_and_remove_file(out, indices_name);
+
+	const unsigned long long counts[2] = { welder.size(), num_triangles };
+	out.seekp(compact_counts_offset);
+	out.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+
+	ok = ok && !out.fail();
+	out.close();
+
+	cout << "Vertex count: " << welder.size() << ", triangle count: " << num_triangles << endl;
+
+	if (0 == num_triangles)
+	{
+		remove(name.c_str());
+		return ok;
+	}
+
+	cout << "Wrote compact mesh file: " << name << endl;
+
+	return ok;
+}
+
+void compact_mesh_writer::abandon(void)
+{
+	if (out.is_open())
+	{
+		out.close();
+		remove(name.c_str());
+	}
+
+	if (indices_out.is_open())
+	{
+		indices_out.close();
+		remove(indices_name.c_str());
+	}
+}
+
+
+
+const char* get_mesh_format_extension(mesh_format format)
+{
+	switch (format)
+	{
+	case ply_mesh_format:
+		return ".ply";
+	case compact_mesh_format:
+		return ".jcm";
+	default:
+		return ".stl";
+	}
+}
+
+mesh_writer* create_mesh_writer(mesh_format format, const vertex_3& bounds_min, const vertex_3& bounds_max)
+{
+	switch (format)
+	{
+	case ply_mesh_format:
+		return new ply_mesh_writer;
+	case compact_mesh_format:
+		return new compact_mesh_writer(bounds_min, bounds_max);
+	default:
+		return new stl_mesh_writer;
+	}
+}
@@ -0,0 +1,261 @@
+#ifndef MESH_WRITER_H
+#define MESH_WRITER_H
+
+#include "primitives.h"
+#include "bounded_queue.h"
+#include "mapped_file.h"
+
+#include <atomic>
+using std::atomic;
+
+#include <fstream>
+using std::ofstream;
+
+#include <map>
+using std::map;
+
+#include <string>
+using std::string;
+
+#include <thread>
+using std::thread;
+
+#include <unordered_map>
+using std::unordered_map;
+
+#include <vector>
+using std::vector;
+
+
+// Size in bytes of the binary Stereo Lithography header (80 byte comment plus 4 byte triangle count),
+// and of one triangle record (twelve 4-byte floats plus one 2-byte attribute).
+const size_t stereo_lithography_header_size = 84;
+const size_t stereo_lithography_record_size = 50;
+
+// Writes the face normal, the three vertices and a zero attribute of one triangle
+// into a 50 byte binary Stereo Lithography record.
+void encode_stereo_lithography_record(const triangle& t, char* const record);
+
+
+class worker_pool;
+
+
+// A mesh file that is written incrementally, one batch of triangles at a time.
+class mesh_writer
+{
+public:
+	virtual ~mesh_writer(void) { }
+
+	virtual bool open(const char* const file_name) = 0;
+	virtual bool write(const triangle_batch& batch) = 0;
+	virtual bool close(void) = 0;
+
+	// Stops writing and deletes what has been written so far, instead of closing a mesh that is incomplete.
+	virtual void abandon(void) = 0;
+};
+
+// Binary Stereo Lithography, streamed out batch by batch into a memory-mapped file. It only has face normals,
+// so any vertex normals are ignored.
+// The file grows geometrically as batches arrive, and each batch is encoded straight into
+// the mapping, in parallel if it is big enough. close() patches in the triangle count and
+// trims the file to its final size.
+class stl_mesh_writer : public mesh_writer
+{
+public:
+	stl_mesh_writer(void) : num_triangles(0), workers(0) { }
+	~stl_mesh_writer(void);
+
+	bool open(const char* const file_name);
+	bool write(const triangle_batch& batch);
+	bool close(void);
+	void abandon(void);
+
+private:
+	stl_mesh_writer(const stl_mesh_writer&);
+	stl_mesh_writer& operator=(const stl_mesh_writer&);
+
+	mapped_file out;
+	string name;
+	size_t num_triangles;
+
+	// Only made once a batch is big enough to be worth splitting.
+	worker_pool* workers;
+};
+
+
+// Hashes and compares vertices by position alone, bit for bit.
+class vertex_position_hash
+{
+public:
+	size_t operator()(const vertex_3& v) const;
+};
+
+class vertex_position_equal
+{
+public:
+	bool operator()(const vertex_3& a, const vertex_3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+};
+
+// Welds identical vertex positions into shared indices, one batch at a time.
+// Marching cubes only shares vertices between adjacent slice pairs, and it produces
+// bit-identical positions for shared edges, so only the current and previous batches
+// are remembered. This keeps memory bounded however big the whole mesh gets.
+class vertex_welder
+{
+public:
+	vertex_welder(void) : num_vertices(0) { }
+
+	// Returns the index of v, and sets is_new if v has not been seen before.
+	size_t weld(const vertex_3& v, bool& is_new);
+
+	// Forget the vertices of the batch before last.
+	void next_batch(void);
+
+	size_t size(void) const { return num_vertices; }
+
+private:
+	typedef unordered_map<vertex_3, size_t, vertex_position_hash, vertex_position_equal> index_map;
+
+	index_map previous;
+	index_map current;
+	size_t num_vertices;
+};
+
+// Indexed binary little-endian PLY with vertex normals (zero if the batches have none), streamed out batch by batch.
+// Vertices go straight to the file, faces go to a side file that is appended by close(),
+// and the element counts in the fixed-width header are patched in by close().
+class ply_mesh_writer : public mesh_writer
+{
+public:
+	ply_mesh_writer(void) : num_triangles(0), vertex_count_offset(0), face_count_offset(0) { }
+
+	bool open(const char* const file_name);
+	bool write(const triangle_batch& batch);
+	bool close(void);
+	void abandon(void);
+
+private:
+	ofstream out;
+	ofstream faces_out;
+	string name;
+	string faces_name;
+	vertex_welder welder;
+	size_t num_triangles;
+	size_t vertex_count_offset;
+	size_t face_count_offset;
+	vector<char> vertex_buffer;
+	vector<char> face_buffer;
+};
+
+// Compact quantized mesh (.jcm), streamed out batch by batch:
+//
+//   char[4]   magic "JCM2"
+//   float[3]  bounds minimum
+//   float[3]  bounds maximum
+//   uint64    vertex count
+//   uint64    triangle count
+//   uint16[3] per vertex: position quantized to 0..65535 across the bounds,
+//   int8[2]   followed by its unit normal in octahedral encoding, scaled to -127..127
+//   varint[]  three indices per triangle, each stored as the zigzag-encoded difference
+//             from the index before it, in LEB128 (7 bits per byte, high bit = more bytes)
+//
+// The indices go to a side file that is appended by close(), and the counts are patched in by close().
+class compact_mesh_writer : public mesh_writer
+{
+public:
+	compact_mesh_writer(const vertex_3& src_bounds_min, const vertex_3& src_bounds_max);
+
+	bool open(const char* const file_name);
+	bool write(const triangle_batch& batch);
+	bool close(void);
+	void abandon(void);
+
+private:
+	ofstream out;
+	ofstream indices_out;
+	string name;
+	string indices_name;
+	vertex_3 bounds_min;
+	vertex_3 bounds_max;
+	vertex_welder welder;
+	size_t num_triangles;
+	size_t previous_index;
+	vector<char> vertex_buffer;
+	vector<char> index_buffer;
+};
+
+enum mesh_format { stl_mesh_format, ply_mesh_format, compact_mesh_format };
+
+// File name extension, including the dot.
+const char* get_mesh_format_extension(mesh_format format);
+
+// The bounds are only used by the compact format, to quantize positions.
+mesh_writer* create_mesh_writer(mesh_format format, const vertex_3& bounds_min, const vertex_3& bounds_max);
+
+
+// Writes meshes on a dedicated I/O thread, so that encoding and disk I/O overlap with evaluation.
+// Any number of meshes can be open at once; each is identified by a caller-chosen stream number.
+// At most queue_depth batches wait in the queue, which bounds the memory held by pending output;
+// the producer blocks when the queue is full.
+class background_mesh_writer
+{
+public:
+	// Every batch buffer going round the queue is given room for batch_reserve triangles up front,
+	// and for their vertex normals too if reserve_normals is set.
+	background_mesh_writer(size_t queue_depth, size_t batch_reserve = 0, bool reserve_normals = false);
+	~background_mesh_writer(void) { finish(); }
+
+	// Takes ownership of writer.
+	void open(size_t stream, mesh_writer* writer, const string& file_name);
+
+	// The batch is swapped into the queue, and is left empty, holding buffers that have
+	// already been written out, so that their room is reused instead of being allocated again.
+	void write(size_t stream, triangle_batch& batch);
+
+	void close(size_t stream);
+
+	// Waits for all pending output to be written, and stops the I/O thread.
+	// Returns false if any open, write or close failed.
+	bool finish(void);
+
+	// Drops the pending output, stops the I/O thread, and abandons every mesh that is still open,
+	// so that a failed render leaves no incomplete files behind. Meshes already closed are kept.
+	void abandon(void);
+
+private:
+	background_mesh_writer(const background_mesh_writer&);
+	background_mesh_writer& operator=(const background_mesh_writer&);
+
+	enum job_type { open_job, write_job, close_job };
+
+	class job
+	{
+	public:
+		job(void) : type(write_job), stream(0), writer(0) { }
+
+		job_type type;
+		size_t stream;
+		mesh_writer* writer;
+		string file_name;
+		triangle_batch batch;
+	};
+
+	void run(void);
+
+	bounded_queue<job> jobs;
+
+	// Only used by the thread that queues jobs. After each push it holds a job that has gone
+	// round the queue, with its buffers emptied.
+	job next;
+
+	size_t batch_reserve;
+	bool reserve_normals;
+	map<size_t, mesh_writer*> writers;
+	thread io_thread;
+	atomic<bool> abandoning;
+	bool ok;
+	bool finished;
+};
+
+
+#endif
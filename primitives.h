@@ -7,6 +7,7 @@
 
 #include <cmath>
 #include <cstddef> // g++ chokes on size_t without this
+#include <vector>
 
 
 class vertex_3
@@ -124,6 +125,61 @@ public:
 	vertex_3 vertex[3];
 };
 
+// A batch of triangles, with the unit vertex normals of triangle i at normals[3 * i] to normals[3 * i + 2]
+// where the mesher provides them. Otherwise normals is empty, so that triangles without vertex normals
+// take no room for them. Every batch of one mesh either has normals or does not.
+class triangle_batch
+{
+public:
+	std::vector<triangle> triangles;
+	std::vector<vertex_3> normals;
+
+	inline size_t size(void) const { return triangles.size(); }
+	inline bool empty(void) const { return triangles.empty(); }
+	inline bool has_normals(void) const { return false == normals.empty(); }
+
+	// The normal of vertex j of triangle i, or zero if there are no normals.
+	inline vertex_3 get_normal(const size_t i, const size_t j) const
+	{
+		return normals.empty() ? vertex_3() : normals[3 * i + j];
+	}
+
+	inline void reserve(const size_t num_triangles, const bool with_normals)
+	{
+		triangles.reserve(num_triangles);
+
+		if(with_normals)
+			normals.reserve(3 * num_triangles);
+	}
+
+	inline void clear(void)
+	{
+		triangles.clear();
+		normals.clear();
+	}
+
+	inline void swap(triangle_batch &other)
+	{
+		triangles.swap(other.triangles);
+		normals.swap(other.normals);
+	}
+
+	// Appends triangle i of other, with its normals if it has any.
+	inline void push_back(const triangle_batch &other, const size_t i)
+	{
+		triangles.push_back(other.triangles[i]);
+
+		if(other.has_normals())
+			normals.insert(normals.end(), other.normals.begin() + 3 * i, other.normals.begin() + 3 * i + 3);
+	}
+
+	inline void append(const triangle_batch &other)
+	{
+		triangles.insert(triangles.end(), other.triangles.begin(), other.triangles.end());
+		normals.insert(normals.end(), other.normals.begin(), other.normals.end());
+	}
+};
+
 
 
 class quaternion
@@ -0,0 +1,904 @@
+#include "render_daemon.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+using namespace std;
+
+
+void write_render_job(ostream& out, const render_job& job)
+{
+	// Enough digits that every float reads back bit for bit, since the field cache keys on them.
+	out << setprecision(numeric_limits<float>::max_digits10);
+
+	out << "x_grid " << job.x_grid_min << " " << job.x_grid_max << " " << job.x_res << "\n";
+	out << "y_grid " << job.y_grid_min << " " << job.y_grid_max << " " << job.y_res << "\n";
+	out << "z_grid " << job.z_grid_min << " " << job.z_grid_max << " " << job.z_res << "\n";
+	out << "w " << job.w_min << " " << job.w_max << " " << job.w_res << "\n";
+
+	for (size_t c = 0; c < job.C_batch.size(); c++)
+		out << "C " << job.C_batch[c].x << " " << job.C_batch[c].y << " " << job.C_batch[c].z << " " << job.C_batch[c].w << "\n";
+
+	out << "max_iterations " << job.max_iterations << "\n";
+	out << "threshold " << job.threshold << "\n";
+	out << "mode " << static_cast<int>(job.mode) << "\n";
+
+	for (size_t i = 0; i < job.isovalues.size(); i++)
+		out << "isovalue " << job.isovalues[i] << "\n";
+
+	out << "budget " << job.budget.device_bytes << " " << job.budget.host_bytes << "\n";
+	out << "output_queue_depth " << job.output_queue_depth << "\n";
+	out << "filter " << job.filter.min_triangles << " " << job.filter.min_extent << " " << job.filter.max_deferred_triangles << "\n";
+	out << "decimation " << job.decimation.max_error << " " << job.decimation.target_ratio << " " << job.decimation.window_batches << "\n";
+	out << "use_field_cache " << (job.use_field_cache ? 1 : 0) << "\n";
+	out << "write_brick_volumes " << (job.write_brick_volumes ? 1 : 0) << "\n";
+	out << "incremental " << (job.incremental ? 1 : 0) << "\n";
+	out << "output_name " << job.output_name << "\n";
+	out << "lod_levels " << job.lod_levels << "\n";
+	out << "deadline_seconds " << job.deadline_seconds << "\n";
+
+	if (false == job.input_brick_volume.empty())
+		out << "input_brick_volume " << job.input_brick_volume << "\n";
+
+	out << "input_region";
+
+	for (size_t i = 0; i < 3; i++)
+		out << " " << job.input_region_min[i] << " " << job.input_region_max[i];
+
+	out << "\n";
+}
+
+bool read_render_job_line(const string& line, render_job& job, bool& read_C, bool& read_isovalue)
+{
+	istringstream in(line);
+	string name;
+
+	if (!(in >> name))
+		return true;
+
+	if ("x_grid" == name)
+		in >> job.x_grid_min >> job.x_grid_max >> job.x_res;
+	else if ("y_grid" == name)
+		in >> job.y_grid_min >> job.y_grid_max >> job.y_res;
+	else if ("z_grid" == name)
+		in >> job.z_grid_min >> job.z_grid_max >> job.z_res;
+	else if ("w" == name)
+		in >> job.w_min >> job.w_max >> job.w_res;
+	else if ("C" == name)
+	{
+		if (false == read_C)
+			job.C_batch.clear();
+
+		read_C = true;
+
+		quaternion C;
+		in >> C.x >> C.y >> C.z >> C.w;
+		job.C_batch.push_back(C);
+	}
+	else if ("max_iterations" == name)
+		in >> job.max_iterations;
+	else if ("threshold" == name)
+		in >> job.threshold;
+	else if ("mode" == name)
+	{
+		int mode = 0;
+		in >> mode;
+
+		if (mode < magnitude_field || mode > distance_field)
+			return false;
+
+		job.mode = static_cast<field_mode>(mode);
+	}
+	else if ("isovalue" == name)
+	{
+		if (false == read_isovalue)
+			job.isovalues.clear();
+
+		read_isovalue = true;
+
+		float isovalue = 0;
+		in >> isovalue;
+		job.isovalues.push_back(isovalue);
+	}
+	else if ("budget" == name)
+		in >> job.budget.device_bytes >> job.budget.host_bytes;
+	else if ("output_queue_depth" == name)
+		in >> job.output_queue_depth;
+	else if ("filter" == name)
+		in >> job.filter.min_triangles >> job.filter.min_extent >> job.filter.max_deferred_triangles;
+	else if ("decimation" == name)
+		in >> job.decimation.max_error >> job.decimation.target_ratio >> job.decimation.window_batches;
+	else if ("use_field_cache" == name)
+		in >> job.use_field_cache;
+	else if ("write_brick_volumes" == name)
+		in >> job.write_brick_volumes;
+	else if ("incremental" == name)
+		in >> job.incremental;
+	else if ("output_name" == name)
+	{
+		in >> ws;
+		getline(in, job.output_name);
+	}
+	else if ("lod_levels" == name)
+		in >> job.lod_levels;
+	else if ("deadline_seconds" == name)
+		in >> job.deadline_seconds;
+	else if ("input_brick_volume" == name)
+	{
+		in >> ws;
+		getline(in, job.input_brick_volume);
+	}
+	else if ("input_region" == name)
+	{
+		for (size_t i = 0; i < 3; i++)
+			in >> job.input_region_min[i] >> job.input_region_max[i];
+	}
+	else
+		return false;
+
+	return !in.fail();
+}
+
+// Whether name is a file name on its own, that cannot reach outside the directory it is put in.
+static bool is_plain_file_name(const string& name)
+{
+	return false == name.empty() && "." != name && ".." != name && string::npos == name.find_first_of("/\\:");
+}
+
+
+#ifdef _WIN32
+
+static bool report_unsupported(void)
+{
+	cout << "The render daemon needs Unix domain sockets, which this build does not support" << endl;
+	return false;
+}
+
+render_daemon::render_daemon(julia_engine& src_engine, size_t src_max_queued_jobs, const string& src_data_directory)
+	: engine(src_engine), max_queued_jobs(src_max_queued_jobs), data_directory(src_data_directory), listener(-1), jobs(src_max_queued_jobs), total_latency_ms(0), total_wait_ms(0)
+{
+}
+
+render_daemon::~render_daemon(void)
+{
+}
+
+bool render_daemon::listen(const char* const socket_path)
+{
+	return report_unsupported();
+}
+
+void render_daemon::run(void)
+{
+}
+
+render_daemon_metrics render_daemon::get_metrics(void)
+{
+	return metrics;
+}
+
+bool render_on_daemon(const char* const socket_path, const render_job& job, render_callbacks* callbacks)
+{
+	return report_unsupported();
+}
+
+bool print_daemon_metrics(const char* const socket_path)
+{
+	return report_unsupported();
+}
+
+bool shut_down_daemon(const char* const socket_path)
+{
+	return report_unsupported();
+}
+
+#else
+
+// How long a connection may take to send its request before it is dropped,
+// so that a stalled client cannot hold up the listening thread.
+const int request_timeout_seconds = 5;
+
+// How long a write to a connection may block, because the client has stopped reading, before the
+// client is dropped. This holds for the whole connection, so that neither the listening thread
+// nor the render thread, which streams the results, can be held up by it.
+const int send_timeout_seconds = 5;
+
+static bool write_all(int connection, const void* data, size_t num_bytes)
+{
+	const char* bytes = static_cast<const char*>(data);
+
+	while (num_bytes > 0)
+	{
+		const ssize_t written = write(connection, bytes, num_bytes);
+
+		if (written < 0 && EINTR == errno)
+			continue;
+
+		if (written <= 0)
+			return false;
+
+		bytes += written;
+		num_bytes -= static_cast<size_t>(written);
+	}
+
+	return true;
+}
+
+static bool write_line(int connection, const string& line)
+{
+	return write_all(connection, line.c_str(), line.size()) && write_all(connection, "\n", 1);
+}
+
+// Buffered reads of lines and binary payloads from one connection.
+class socket_reader
+{
+public:
+	socket_reader(int src_connection) : connection(src_connection), begin(0) { }
+
+	bool read_line(string& line)
+	{
+		for (;;)
+		{
+			const size_t end = buffer.find('\n', begin);
+
+			if (string::npos != end)
+			{
+				line.assign(buffer, begin, end - begin);
+				begin = end + 1;
+				return true;
+			}
+
+			if (false == fill())
+				return false;
+		}
+	}
+
+	bool read_bytes(void* data, size_t num_bytes)
+	{
+		char* bytes = static_cast<char*>(data);
+
+		while (num_bytes > 0)
+		{
+			if (begin == buffer.size() && false == fill())
+				return false;
+
+			const size_t count = min(num_bytes, buffer.size() - begin);
+			memcpy(bytes, &buffer[begin], count);
+			bytes += count;
+			begin += count;
+			num_bytes -= count;
+		}
+
+		return true;
+	}
+
+private:
+	bool fill(void)
+	{
+		buffer.erase(0, begin);
+		begin = 0;
+
+		char chunk[65536];
+
+		for (;;)
+		{
+			const ssize_t num_read = read(connection, chunk, sizeof(chunk));
+
+			if (num_read < 0 && EINTR == errno)
+				continue;
+
+			if (num_read <= 0)
+				return false;
+
+			buffer.append(chunk, static_cast<size_t>(num_read));
+			return true;
+		}
+	}
+
+	int connection;
+	string buffer;
+	size_t begin;
+};
+
+static int connect_to_daemon(const char* const socket_path)
+{
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	if (strlen(socket_path) >= sizeof(address.sun_path))
+		return -1;
+
+	strcpy(address.sun_path, socket_path);
+
+	const int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (connection < 0)
+		return -1;
+
+	if (0 != connect(connection, reinterpret_cast<const sockaddr*>(&address), sizeof(address)))
+	{
+		close(connection);
+		return -1;
+	}
+
+	return connection;
+}
+
+// Streams a job's results back to the client that sent it. Triangles arrive on the engine's
+// output thread and statistics on the rendering thread, so writes are serialized.
+// If the client goes away, the job still runs to completion, and its results are dropped.
+class socket_callbacks : public render_callbacks
+{
+public:
+	socket_callbacks(int src_connection) : connection(src_connection), connected(true) { }
+
+	void on_triangles(size_t c, size_t w, size_t level, const triangle_batch& batch)
+	{
+		lock_guard<mutex> lock(m);
+
+		const vector<triangle>& triangles = batch.triangles;
+		const size_t floats_per_triangle = batch.has_normals() ? 18 : 9;
+
+		payload.resize(triangles.size() * floats_per_triangle);
+
+		for (size_t i = 0; i < triangles.size(); i++)
+		{
+			for (size_t j = 0; j < 3; j++)
+			{
+				payload[9 * i + 3 * j + 0] = triangles[i].vertex[j].x;
+				payload[9 * i + 3 * j + 1] = triangles[i].vertex[j].y;
+				payload[9 * i + 3 * j + 2] = triangles[i].vertex[j].z;
+			}
+		}
+
+		if (batch.has_normals())
+		{
+			float* const normals = &payload[9 * triangles.size()];
+
+			for (size_t i = 0; i < batch.normals.size(); i++)
+			{
+				normals[3 * i + 0] = batch.normals[i].x;
+				normals[3 * i + 1] = batch.normals[i].y;
+				normals[3 * i + 2] = batch.normals[i].z;
+			}
+		}
+
+		ostringstream header;
+		header << "triangles " << c << " " << w << " " << level << " " << triangles.size() << " " << (batch.has_normals() ? 1 : 0);
+
+		connected = connected && write_line(connection, header.str()) && (payload.empty() || write_all(connection, &payload[0], payload.size() * sizeof(float)));
+	}
+
+	void on_mesh_complete(size_t c, size_t w, size_t level)
+	{
+		ostringstream line;
+		line << "mesh_complete " << c << " " << w << " " << level;
+
+		send(line.str());
+	}
+
+	void on_lod_level(size_t lod, size_t num_lods, size_t x_res, size_t y_res, size_t z_res)
+	{
+		ostringstream line;
+		line << "lod " << lod << " " << num_lods << " " << x_res << " " << y_res << " " << z_res;
+
+		send(line.str());
+	}
+
+	void on_stats(const render_stats& stats)
+	{
+		ostringstream line;
+		line << "stats " << stats.planes_done << " " << stats.num_planes << " " << stats.num_points << " "
+			<< stats.num_in_set << " " << stats.num_triangles << " " << stats.seconds << " "
+			<< stats.surface_area << " " << stats.min_orbit_magnitude << " " << stats.max_orbit_magnitude << " "
+			<< stats.escape_histogram.size();
+
+		for (size_t i = 0; i < stats.escape_histogram.size(); i++)
+			line << " " << stats.escape_histogram[i];
+
+		send(line.str());
+	}
+
+	void send(const string& line)
+	{
+		lock_guard<mutex> lock(m);
+
+		connected = connected && write_line(connection, line);
+	}
+
+private:
+	int connection;
+	bool connected;
+	mutex m;
+	vector<float> payload;
+};
+
+
+render_daemon::render_daemon(julia_engine& src_engine, size_t src_max_queued_jobs, const string& src_data_directory)
+	: engine(src_engine), max_queued_jobs(src_max_queued_jobs), data_directory(src_data_directory), listener(-1), jobs(src_max_queued_jobs), total_latency_ms(0), total_wait_ms(0)
+{
+}
+
+render_daemon::~render_daemon(void)
+{
+	// Wakes up the listening thread if it is still waiting for a connection.
+	if (listener >= 0)
+		shutdown(listener, SHUT_RDWR);
+
+	if (listener_thread.joinable())
+		listener_thread.join();
+
+	if (listener >= 0)
+	{
+		close(listener);
+		unlink(path.c_str());
+	}
+
+	// Anything still queued will never be rendered.
+	jobs.close();
+
+	queued_job item;
+
+	while (jobs.pop(item))
+		close(item.connection);
+}
+
+bool render_daemon::listen(const char* const socket_path)
+{
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	if (strlen(socket_path) >= sizeof(address.sun_path))
+	{
+		cout << "Socket path is too long: " << socket_path << endl;
+		return false;
+	}
+
+	strcpy(address.sun_path, socket_path);
+
+	// A socket file that nobody answers on was left behind by a daemon that did not exit cleanly.
+	const int existing = connect_to_daemon(socket_path);
+
+	if (existing >= 0)
+	{
+		close(existing);
+		cout << "A daemon is already listening on " << socket_path << endl;
+		return false;
+	}
+
+	unlink(socket_path);
+
+	// Clients that disconnect early must not take the daemon down with them.
+	signal(SIGPIPE, SIG_IGN);
+
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (listener < 0 || 0 != bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) || 0 != ::listen(listener, 16))
+	{
+		cout << "Couldn't listen on " << socket_path << ": " << strerror(errno) << endl;
+
+		if (listener >= 0)
+			close(listener);
+
+		listener = -1;
+		return false;
+	}
+
+	path = socket_path;
+	listener_thread = thread(&render_daemon::accept_connections, this);
+
+	cout << "Listening on " << socket_path << endl;
+
+	return true;
+}
+
+void render_daemon::run(void)
+{
+	queued_job item;
+
+	while (jobs.pop(item))
+	{
+		{
+			lock_guard<mutex> lock(metrics_mutex);
+			metrics.jobs_running = 1;
+		}
+
+		const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		const double wait_ms = chrono::duration<double, milli>(start - item.received).count();
+
+		socket_callbacks callbacks(item.connection);
+		const bool ok = engine.render(item.job, &callbacks);
+
+		const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+		const double render_ms = chrono::duration<double, milli>(end - start).count();
+
+		ostringstream done;
+		done << "done " << (ok ? 1 : 0) << " " << wait_ms << " " << render_ms;
+		callbacks.send(done.str());
+
+		close(item.connection);
+
+		record_job(ok, wait_ms, chrono::duration<double, milli>(end - item.received).count());
+	}
+
+	cout << "Render daemon stopped" << endl;
+}
+
+render_daemon_metrics render_daemon::get_metrics(void)
+{
+	lock_guard<mutex> lock(metrics_mutex);
+
+	render_daemon_metrics current = metrics;
+	current.queue_depth = jobs.size();
+
+	return current;
+}
+
+void render_daemon::record_job(bool ok, double wait_ms, double latency_ms)
+{
+	lock_guard<mutex> lock(metrics_mutex);
+
+	metrics.jobs_running = 0;
+
+	if (ok)
+		metrics.jobs_completed++;
+	else
+		metrics.jobs_failed++;
+
+	total_latency_ms += latency_ms;
+	total_wait_ms += wait_ms;
+
+	const size_t num_jobs = metrics.jobs_completed + metrics.jobs_failed;
+
+	metrics.last_latency_ms = latency_ms;
+	metrics.mean_latency_ms = total_latency_ms / num_jobs;
+	metrics.mean_wait_ms = total_wait_ms / num_jobs;
+
+	if (latency_ms > metrics.max_latency_ms)
+		metrics.max_latency_ms = latency_ms;
+}
+
+bool render_daemon::restrict_client_job(render_job& job, string& error) const
+{
+	// The meshes go back over the socket, not into files next to the daemon, and a client
+	// must not be able to fill the daemon's disk with brick volumes or cached fields.
+	job.write_mesh_files = false;
+	job.write_brick_volumes = false;
+	job.use_field_cache = false;
+
+	if (false == is_plain_file_name(job.output_name))
+	{
+		error = "output_name must be a plain file name";
+		return false;
+	}
+
+	if (job.input_brick_volume.empty())
+		return true;
+
+	if (data_directory.empty())
+	{
+		error = "this daemon has no data directory to read brick volumes from";
+		return false;
+	}
+
+	if (false == is_plain_file_name(job.input_brick_volume))
+	{
+		error = "input_brick_volume must be a plain file name";
+		return false;
+	}
+
+	job.input_brick_volume = data_directory + "/" + job.input_brick_volume;
+
+	return true;
+}
+
+void render_daemon::accept_connections(void)
+{
+	for (;;)
+	{
+		const int connection = accept(listener, 0, 0);
+
+		if (connection < 0)
+		{
+			if (EINTR == errno)
+				continue;
+
+			break;
+		}
+
+		timeval timeout;
+		timeout.tv_sec = request_timeout_seconds;
+		timeout.tv_usec = 0;
+		setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		timeval send_timeout;
+		send_timeout.tv_sec = send_timeout_seconds;
+		send_timeout.tv_usec = 0;
+		setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+		socket_reader reader(connection);
+		string request;
+
+		if (false == reader.read_line(request))
+		{
+			close(connection);
+			continue;
+		}
+
+		if ("shutdown" == request)
+		{
+			close(connection);
+			break;
+		}
+
+		if ("metrics" == request)
+		{
+			const render_daemon_metrics m = get_metrics();
+
+			ostringstream answer;
+			answer << "queue_depth " << m.queue_depth << "\n"
+				<< "jobs_running " << m.jobs_running << "\n"
+				<< "jobs_completed " << m.jobs_completed << "\n"
+				<< "jobs_failed " << m.jobs_failed << "\n"
+				<< "jobs_rejected " << m.jobs_rejected << "\n"
+				<< "last_latency_ms " << m.last_latency_ms << "\n"
+				<< "mean_latency_ms " << m.mean_latency_ms << "\n"
+				<< "max_latency_ms " << m.max_latency_ms << "\n"
+				<< "mean_wait_ms " << m.mean_wait_ms << "\n"
+				<< "end";
+
+			write_line(connection, answer.str());
+			close(connection);
+			continue;
+		}
+
+		if ("render" != request)
+		{
+			write_line(connection, "error unknown request: " + request);
+			close(connection);
+			continue;
+		}
+
+		queued_job item;
+		item.received = chrono::steady_clock::now();
+
+		bool read_C = false;
+		bool read_isovalue = false;
+		bool ok = true;
+		string line;
+
+		while ((ok = reader.read_line(line)) && "end" != line)
+		{
+			if (false == read_render_job_line(line, item.job, read_C, read_isovalue))
+			{
+				write_line(connection, "error bad job field: " + line);
+				ok = false;
+				break;
+			}
+		}
+
+		if (false == ok)
+		{
+			close(connection);
+			continue;
+		}
+
+		string error;
+
+		if (false == restrict_client_job(item.job, error))
+		{
+			write_line(connection, "error " + error);
+			close(connection);
+			continue;
+		}
+
+		// Only this thread adds jobs, so the queue cannot fill up between the check and the push.
+		const size_t jobs_ahead = jobs.size();
+
+		if (jobs_ahead >= max_queued_jobs)
+		{
+			{
+				lock_guard<mutex> lock(metrics_mutex);
+				metrics.jobs_rejected++;
+			}
+
+			write_line(connection, "error queue full");
+			close(connection);
+			continue;
+		}
+
+		ostringstream queued;
+		queued << "queued " << jobs_ahead;
+		write_line(connection, queued.str());
+
+		// The results are streamed back without a deadline.
+		timeout.tv_sec = 0;
+		setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		item.connection = connection;
+		jobs.push(item);
+	}
+
+	// Let run() drain what is queued, and return.
+	jobs.close();
+}
+
+
+bool render_on_daemon(const char* const socket_path, const render_job& job, render_callbacks* callbacks)
+{
+	signal(SIGPIPE, SIG_IGN);
+
+	const int connection = connect_to_daemon(socket_path);
+
+	if (connection < 0)
+	{
+		cout << "Couldn't connect to a daemon on " << socket_path << endl;
+		return false;
+	}
+
+	ostringstream request;
+	request << "render\n";
+	write_render_job(request, job);
+	request << "end\n";
+
+	if (false == write_all(connection, request.str().c_str(), request.str().size()))
+	{
+		cout << "Couldn't send the job to the daemon" << endl;
+		close(connection);
+		return false;
+	}
+
+	socket_reader reader(connection);
+	string line;
+	vector<float> payload;
+	triangle_batch batch;
+
+	while (reader.read_line(line))
+	{
+		istringstream in(line);
+		string kind;
+		in >> kind;
+
+		if ("triangles" == kind)
+		{
+			size_t c = 0, w = 0, level = 0, count = 0, has_normals = 0;
+			in >> c >> w >> level >> count >> has_normals;
+
+			payload.resize(count * (0 != has_normals ? 18 : 9));
+
+			if (count > 0 && false == reader.read_bytes(&payload[0], payload.size() * sizeof(float)))
+				break;
+
+			batch.triangles.resize(count);
+			batch.normals.resize(0 != has_normals ? 3 * count : 0);
+
+			for (size_t i = 0; i < count; i++)
+				for (size_t j = 0; j < 3; j++)
+					batch.triangles[i].vertex[j] = vertex_3(payload[9 * i + 3 * j + 0], payload[9 * i + 3 * j + 1], payload[9 * i + 3 * j + 2], 0);
+
+			for (size_t i = 0; i < batch.normals.size(); i++)
+				batch.normals[i] = vertex_3(payload[9 * count + 3 * i + 0], payload[9 * count + 3 * i + 1], payload[9 * count + 3 * i + 2], 0);
+
+			if (0 != callbacks)
+				callbacks->on_triangles(c, w, level, batch);
+		}
+		else if ("mesh_complete" == kind)
+		{
+			size_t c = 0, w = 0, level = 0;
+			in >> c >> w >> level;
+
+			if (0 != callbacks)
+				callbacks->on_mesh_complete(c, w, level);
+		}
+		else if ("lod" == kind)
+		{
+			size_t lod = 0, num_lods = 0, x_res = 0, y_res = 0, z_res = 0;
+			in >> lod >> num_lods >> x_res >> y_res >> z_res;
+
+			if (0 != callbacks)
+				callbacks->on_lod_level(lod, num_lods, x_res, y_res, z_res);
+		}
+		else if ("stats" == kind)
+		{
+			render_stats stats;
+			size_t histogram_size = 0;
+			in >> stats.planes_done >> stats.num_planes >> stats.num_points >> stats.num_in_set >> stats.num_triangles >> stats.seconds
+				>> stats.surface_area >> stats.min_orbit_magnitude >> stats.max_orbit_magnitude >> histogram_size;
+
+			stats.escape_histogram.resize(histogram_size, 0);
+
+			for (size_t i = 0; i < histogram_size; i++)
+			{
+				in >> stats.escape_histogram[i];
+
+				// Every orbit seen lands in some bin, including orbits of zero magnitude.
+				if (stats.escape_histogram[i] > 0)
+					stats.has_orbit_samples = true;
+			}
+
+			if (0 != callbacks)
+				callbacks->on_stats(stats);
+		}
+		else if ("queued" == kind)
+		{
+			size_t jobs_ahead = 0;
+			in >> jobs_ahead;
+
+			if (jobs_ahead > 0)
+				cout << "Queued behind " << jobs_ahead << " job(s)" << endl;
+		}
+		else if ("done" == kind)
+		{
+			int ok = 0;
+			double wait_ms = 0, render_ms = 0;
+			in >> ok >> wait_ms >> render_ms;
+
+			cout << "Daemon " << (ok ? "rendered" : "failed") << " the job in " << render_ms << " ms, after " << wait_ms << " ms queued" << endl;
+
+			close(connection);
+			return 0 != ok;
+		}
+		else
+		{
+			cout << "Daemon: " << line << endl;
+			break;
+		}
+	}
+
+	cout << "The daemon closed the connection before the job was done" << endl;
+	close(connection);
+	return false;
+}
+
+bool print_daemon_metrics(const char* const socket_path)
+{
+	const int connection = connect_to_daemon(socket_path);
+
+	if (connection < 0)
+	{
+		cout << "Couldn't connect to a daemon on " << socket_path << endl;
+		return false;
+	}
+
+	write_line(connection, "metrics");
+
+	socket_reader reader(connection);
+	string line;
+
+	while (reader.read_line(line) && "end" != line)
+		cout << line << endl;
+
+	close(connection);
+
+	return "end" == line;
+}
+
+bool shut_down_daemon(const char* const socket_path)
+{
+	const int connection = connect_to_daemon(socket_path);
+
+	if (connection < 0)
+	{
+		cout << "Couldn't connect to a daemon on " << socket_path << endl;
+		return false;
+	}
+
+	const bool ok = write_line(connection, "shutdown");
+	close(connection);
+
+	return ok;
+}
+
+#endif
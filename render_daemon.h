@@ -0,0 +1,141 @@
+#ifndef RENDER_DAEMON_H
+#define RENDER_DAEMON_H
+
+#include "julia_engine.h"
+#include "bounded_queue.h"
+
+#include <chrono>
+
+#include <iostream>
+using std::istream;
+using std::ostream;
+
+#include <string>
+using std::string;
+
+#include <thread>
+using std::thread;
+
+
+// The daemon protocol is line-based text, so that a test client can be as simple as nc -U.
+// A client connects, sends one request, and reads until the daemon closes the connection.
+//
+//   render            followed by render_job fields, one per line as written by write_render_job(),
+//   ...               any of which can be left out to keep its default, and then a line "end".
+//   end               The daemon answers with "queued <jobs ahead>", then streams, as they are made:
+//                       triangles <c> <w> <level> <count> <1 if it has vertex normals, else 0>
+//                                         followed by count * 9 native floats, three vertices per triangle,
+//                                         then, with vertex normals, count * 9 more, three normals per triangle
+//                       mesh_complete <c> <w> <level>
+//                       lod <level of detail> <levels> <x res> <y res> <z res>
+//                       stats <planes done> <planes> <points> <in set> <triangles> <seconds> <surface area>
+//                             <min orbit magnitude> <max orbit magnitude> <histogram size> <escape histogram...>
+//                     and finally "done <1 if it succeeded, else 0> <ms queued> <ms rendering>".
+//
+//   metrics           The daemon answers with "<name> <value>" lines, and then "end".
+//
+//   shutdown          The daemon finishes the jobs it has queued, and exits.
+//
+// A request the daemon cannot accept is answered with "error <message>".
+//
+// Jobs never write files: mesh files, brick volumes and the field cache are turned off, whatever the
+// client asks for, and the shaders are compiled from memory. output_name and input_brick_volume must be plain file names, without any directory,
+// and an input brick volume is only read from the daemon's data directory, if it was given one.
+
+// Writes every field of the job as a "<name> <values>" line, with floats written exactly.
+void write_render_job(ostream& out, const render_job& job);
+
+// Reads one line written by write_render_job() into the job. The first C or isovalue line replaces
+// the job's C_batch or isovalues, and later ones add to them. Returns false for an unknown field.
+bool read_render_job_line(const string& line, render_job& job, bool& read_C, bool& read_isovalue);
+
+
+// Queue and latency figures, as answered to a metrics request.
+class render_daemon_metrics
+{
+public:
+	render_daemon_metrics(void) : queue_depth(0), jobs_running(0), jobs_completed(0), jobs_failed(0), jobs_rejected(0), last_latency_ms(0), mean_latency_ms(0), max_latency_ms(0), mean_wait_ms(0) { }
+
+	size_t queue_depth; // jobs waiting to start
+	size_t jobs_running;
+	size_t jobs_completed;
+	size_t jobs_failed;
+	size_t jobs_rejected; // turned away because the queue was full
+	double last_latency_ms; // from the request arriving to the last result being sent
+	double mean_latency_ms;
+	double max_latency_ms;
+	double mean_wait_ms; // time spent queued
+};
+
+// Serves render jobs over a Unix domain socket, one at a time, with a single engine, so that the
+// GL context, the compiled shaders, the calibrated evaluator and the remembered field volumes that
+// panning and refining start from stay warm between jobs. The field cache is not used, since it
+// lives on disk. Requests are read on a listening thread; jobs are rendered on the thread that calls run(),
+// which is the only thread that ever touches the context.
+class render_daemon
+{
+public:
+	// Jobs beyond max_queued_jobs are turned away rather than left waiting. Input brick volumes
+	// are read from data_directory; if it is empty, jobs that name one are turned away.
+	render_daemon(julia_engine& src_engine, size_t max_queued_jobs, const string& data_directory = "");
+	~render_daemon(void);
+
+	// Creates the socket, replacing a stale one left at socket_path. Prints a message and returns false on failure.
+	bool listen(const char* const socket_path);
+
+	// Renders jobs as they arrive, until a shutdown request has been received and the queue drained.
+	void run(void);
+
+	render_daemon_metrics get_metrics(void);
+
+private:
+	render_daemon(const render_daemon&);
+	render_daemon& operator=(const render_daemon&);
+
+	class queued_job
+	{
+	public:
+		queued_job(void) : connection(-1) { }
+
+		int connection;
+		render_job job;
+		std::chrono::steady_clock::time_point received;
+	};
+
+	// Accepts connections and answers or queues their requests, until a shutdown request.
+	void accept_connections(void);
+
+	// Turns off everything in a client's job that writes files, and resolves its input brick volume
+	// inside the data directory. Returns false, with the reason in error, if the job names a path.
+	bool restrict_client_job(render_job& job, string& error) const;
+
+	void record_job(bool ok, double wait_ms, double latency_ms);
+
+	julia_engine& engine;
+	size_t max_queued_jobs;
+	string data_directory;
+
+	string path;
+	int listener;
+	thread listener_thread;
+	bounded_queue<queued_job> jobs;
+
+	mutex metrics_mutex;
+	render_daemon_metrics metrics;
+	double total_latency_ms;
+	double total_wait_ms;
+};
+
+// Sends the job to the daemon listening at socket_path, and hands the triangles, mesh completions,
+// levels of detail and statistics that it streams back to the callbacks, on the calling thread. Field planes are
+// not sent over the socket. Prints a message and returns false if the job failed.
+bool render_on_daemon(const char* const socket_path, const render_job& job, render_callbacks* callbacks);
+
+// Asks the daemon for its metrics, and prints them.
+bool print_daemon_metrics(const char* const socket_path);
+
+// Asks the daemon to finish its queued jobs and exit.
+bool shut_down_daemon(const char* const socket_path);
+
+
+#endif
@@ -3,21 +3,36 @@
 
 bool vertex_geometry_shader::init(const char* vertex_shader_filename, const char* geometry_shader_filename, string varying_name)
 {
-	program = glCreateProgram();
+	const GLchar* vertex_source = read_text_file(vertex_shader_filename);
 
-	GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+	if (vertex_source == NULL)
+		return false;
 
-	const GLchar* source = read_text_file(vertex_shader_filename);
+	const GLchar* geometry_source = read_text_file(geometry_shader_filename);
 
-	if (source == NULL)
+	if (geometry_source == NULL)
 	{
-		glDeleteProgram(program);
-		glDeleteShader(vertex_shader);
+		delete[] vertex_source;
 		return false;
 	}
 
+	const bool ok = init_from_sources(vertex_source, geometry_source, varying_name);
+
+	delete[] vertex_source;
+	delete[] geometry_source;
+
+	return ok;
+}
+
+bool vertex_geometry_shader::init_from_sources(const string& vertex_shader_source, const string& geometry_shader_source, string varying_name)
+{
+	program = glCreateProgram();
+
+	GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+
+	const GLchar* source = vertex_shader_source.c_str();
+
 	glShaderSource(vertex_shader, 1, &source, NULL);
-	delete[] source;
 
 	glCompileShader(vertex_shader);
 	GLint compiled;
@@ -44,18 +59,9 @@ bool vertex_geometry_shader::init(const char* vertex_shader_filename, const char
 
 	GLuint geometry_shader = glCreateShader(GL_GEOMETRY_SHADER);
 
-	source = read_text_file(geometry_shader_filename);
-
-	if (source == NULL)
-	{
-		glDeleteProgram(program);
-		glDeleteShader(vertex_shader);
-		glDeleteShader(geometry_shader);
-		return false;
-	}
+	source = geometry_shader_source.c_str();
 
 	glShaderSource(geometry_shader, 1, &source, NULL);
-	delete[] source;
 
 	glCompileShader(geometry_shader);
 	glGetShaderiv(geometry_shader, GL_COMPILE_STATUS, &compiled);
@@ -17,6 +17,7 @@ public:
 	~vertex_geometry_shader(void) { if (program != 0) { glDeleteProgram(program); } }
 
 	bool init(const char* vertex_shader_filename, const char* geometry_shader_filename, string varying_name);
+	bool init_from_sources(const string& vertex_shader_source, const string& geometry_shader_source, string varying_name);
 	void use_program(void);
 	GLuint get_program(void) { return program; };
 
@@ -0,0 +1,129 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+using std::condition_variable;
+using std::mutex;
+using std::thread;
+using std::unique_lock;
+using std::vector;
+
+
+// A fixed set of threads, made once, that split a range of work between them.
+// Unlike starting a thread per range, running a task allocates nothing.
+class worker_pool
+{
+public:
+	// Zero threads means one per hardware thread.
+	worker_pool(size_t num_threads = 0) : task(0), call(0), num_items(0), generation(0), num_busy(0), stopping(false)
+	{
+		if (0 == num_threads)
+			num_threads = thread::hardware_concurrency();
+
+		if (num_threads < 1)
+			num_threads = 1;
+
+		for (size_t t = 0; t < num_threads; t++)
+			threads.push_back(thread(&worker_pool::work, this, t));
+	}
+
+	~worker_pool(void)
+	{
+		{
+			unique_lock<mutex> lock(m);
+			stopping = true;
+			work_ready.notify_all();
+		}
+
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+	}
+
+	size_t get_num_threads(void) const { return threads.size(); }
+
+	// Splits [0, count) into one contiguous range per thread, calls range_task(begin, end) for each,
+	// and returns once they have all finished. Only one task runs at a time.
+	template<typename range_function>
+	void run(size_t count, range_function& range_task)
+	{
+		if (0 == count)
+			return;
+
+		unique_lock<mutex> lock(m);
+
+		task = &range_task;
+		call = &call_task<range_function>;
+		num_items = count;
+		num_busy = threads.size();
+		generation++;
+
+		work_ready.notify_all();
+		work_done.wait(lock, [this]() { return 0 == num_busy; });
+
+		task = 0;
+	}
+
+private:
+	worker_pool(const worker_pool&);
+	worker_pool& operator=(const worker_pool&);
+
+	template<typename range_function>
+	static void call_task(void* range_task, size_t begin, size_t end)
+	{
+		(*static_cast<range_function*>(range_task))(begin, end);
+	}
+
+	void work(size_t index)
+	{
+		size_t done_generation = 0;
+
+		for (;;)
+		{
+			void* current_task;
+			void (*current_call)(void*, size_t, size_t);
+			size_t begin, end;
+
+			{
+				unique_lock<mutex> lock(m);
+
+				work_ready.wait(lock, [&]() { return stopping || generation != done_generation; });
+
+				if (stopping)
+					return;
+
+				done_generation = generation;
+				current_task = task;
+				current_call = call;
+				begin = num_items * index / threads.size();
+				end = num_items * (index + 1) / threads.size();
+			}
+
+			if (begin < end)
+				current_call(current_task, begin, end);
+
+			unique_lock<mutex> lock(m);
+
+			if (0 == --num_busy)
+				work_done.notify_one();
+		}
+	}
+
+	vector<thread> threads;
+
+	mutex m;
+	condition_variable work_ready;
+	condition_variable work_done;
+
+	void* task;
+	void (*call)(void*, size_t, size_t);
+	size_t num_items;
+	size_t generation;
+	size_t num_busy;
+	bool stopping;
+};
+
+
+#endif